@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2025 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -19,18 +19,14 @@
 /**
  * Timeout management
  *
- * The timeout management is global to a service instance: there is only one timeout deadline for all pending requests.
- * This allows to have a simple implementation but the timeout is less precise.
+ * Each pending request has its own deadline and it is tracked by a hashed timing wheel (see TLRequestTimeoutWheel).
  *
- * When a first request is sent, a timeout deadline is computed for the request and a Job is scheduled with the JobService.
- * The job is scheduled TIMEOUT_CHECK_DELAY (2.0) seconds after the deadline. The requestId is added to the pendingRequestIdList set.
+ * When a request is sent, its deadline is computed TIMEOUT_CHECK_DELAY (2.0) seconds after the request timeout and the
+ * request is added to the wheel.  A single Job is scheduled with the JobService for the earliest deadline of the wheel:
+ * it is re-scheduled when a request with an earlier deadline is added.
  *
- * When another request is sent, a new deadline time is computed and it replaces the current deadline. The scheduled job
- * is not modified. The requestId is also added to the pendingRequestIdList set.
- *
- * When the timeout job is executed, we look at the deadline and if it was passed, all pending requests are reported
- * with an error.  If the deadline has not passed and we still have pending requests, a new job is scheduled TIMEOUT_CHECK_DELAY
- * seconds after the deadline.
+ * When the timeout job is executed, only the requests whose deadline has passed are reported with an error and the job
+ * is scheduled again for the next deadline if there are still pending requests.
  *
  * When a response is received, we expect the receive handler to call receivedIQ so that we remove the requestId from the pending list.
  */
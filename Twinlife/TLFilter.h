@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2023 twinlife SA.
+ *  Copyright (c) 2023-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -20,7 +20,8 @@ typedef BOOL (^TLFilterAcceptor) (id<TLDatabaseObject> _Nonnull object);
  * - filter objects with a given owner (space),
  * - filter objects before a given date,
  * - filter objects matching a name (limited SQL LIKE),
- * - filter objects using a given twincode.
+ * - filter objects using a given twincode,
+ * - limit the number of objects returned.
  */
 @interface TLFilter : NSObject
 
@@ -28,6 +29,7 @@ typedef BOOL (^TLFilterAcceptor) (id<TLDatabaseObject> _Nonnull object);
 @property (nullable) NSString *name;
 @property (nullable) TLTwincodeOutbound *twincodeOutbound;
 @property int64_t before;
+@property int limit;
 @property (nullable) TLFilterAcceptor acceptWithObject;
 
 @end
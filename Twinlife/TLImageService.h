@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020-2024 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -26,12 +26,32 @@ typedef enum {
     TLImageServiceKindLarge      // full scale (optional)
 } TLImageServiceKind;
 
+//
+// Interface: TLImageCacheStats
+//
+
+/// Image cache statistics for a kind of image: images found in memory, images found on the device
+/// (database for thumbnails, cache directory for other images) and images not found locally.
+@interface TLImageCacheStats : NSObject
+
+@property (readonly) int64_t memoryHits;
+@property (readonly) int64_t diskHits;
+@property (readonly) int64_t misses;
+
+/// Ratio of image requests served from the device (memory or disk) in the range [0, 1].
+- (double)hitRatio;
+
+@end
+
 //
 // Interface: TLImageServiceConfiguration
 //
 
 @interface TLImageServiceConfiguration : TLBaseServiceConfiguration
 
+/// Maximum number of image fetches that a prefetch keeps in flight on the server connection.
+@property int maxPrefetchRequests;
+
 @end
 
 //
@@ -51,10 +71,19 @@ typedef enum {
 /// This method is not allowed from the main UI thread as it can block due to possible database access.
 - (nullable UIImage *)getCachedImageWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind;
 
+/// Get the image cache statistics for the given kind of image.
+- (nonnull TLImageCacheStats *)getCacheStatsWithKind:(TLImageServiceKind)kind;
+
 /// Get the image identified by the imageId and call the consumer onGet operation with it.
 /// When the image was not found, the onGet() receives the ITEM_NOT_FOUND error and a null image.
 - (void)getImageWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind) kind withBlock:(nonnull void (^)(TLBaseServiceErrorCode errorCode, UIImage *_Nullable image))block;
 
+/// Load in the background the images identified by the list so that a later getImage finds them in the cache.
+/// The images which are not found locally are fetched from the server with at most `maxPrefetchRequests`
+/// requests in flight.  Concurrent requests for the same image share the same server request.
+/// This method is not allowed from the main UI thread as it can block due to possible database access.
+- (void)prefetchImagesWithImageIds:(nonnull NSArray<TLImageId *> *)imageIds kind:(TLImageServiceKind)kind;
+
 /// Create an image identifier associated with the given image and its thumbnail.
 /// The image can be retrieved through `getImage`.  Once the image is saved and an identifier
 /// allocated, the consumer onGet operation is called with the new image identifier.
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2019-2025 twinlife SA.
+ *  Copyright (c) 2019-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -43,6 +43,47 @@ typedef enum {
 /// Operation called by the job service when it decides the conditions are met to execute the job.
 - (void)runJob;
 
+@optional
+
+/// Returns YES when `runJob` has started some asynchronous work which is not terminated.
+/// The job must then call `finishWithJob:` on the job service when that work terminates.
+- (BOOL)isJobRunning;
+
+@end
+
+//
+// TLJobTrace
+//
+
+/// Execution record of a job kept by the job service to find which jobs consume the execution time.
+@interface TLJobTrace : NSObject
+
+@property (readonly, nonnull) NSString *name;      // Class name of the job.
+@property (readonly) TLJobPriority priority;
+@property (readonly, nonnull) NSDate *scheduledDate; // Job deadline or date when it was scheduled.
+@property (readonly, nonnull) NSDate *startDate;
+@property (readonly) int64_t delay;                // Time in ms between the scheduled date and the start.
+@property (readonly) int64_t duration;             // Execution time in us, including the asynchronous work.
+@property (readonly) BOOL background;              // The job was executed while in background.
+
+@end
+
+//
+// TLJobStats
+//
+
+/// Aggregated execution statistics for a class of job since the application started.
+@interface TLJobStats : NSObject
+
+@property (readonly, nonnull) NSString *name;
+@property (readonly) long runCount;
+@property (readonly) long backgroundCount;
+@property (readonly) int64_t totalDuration;        // us
+@property (readonly) int64_t backgroundDuration;   // us
+@property (readonly) int64_t maxDuration;          // us
+@property (readonly) int64_t totalDelay;           // ms
+@property (readonly) int64_t maxDelay;             // ms
+
 @end
 
 //
@@ -102,4 +143,13 @@ typedef enum {
 /// When the network lock is not needed anymore, its `release` operation must be called.
 - (nonnull TLNetworkLock *)allocateNetworkLock;
 
+/// Report that the asynchronous work started by the job `runJob` operation is terminated.
+- (void)finishWithJob:(nonnull id<TLJob>)job;
+
+/// Get the execution records of the last jobs, the oldest first.
+- (nonnull NSArray<TLJobTrace *> *)getJobTraces;
+
+/// Get the execution statistics of each class of job.
+- (nonnull NSArray<TLJobStats *> *)getJobStats;
+
 @end
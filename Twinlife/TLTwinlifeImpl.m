@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2013-2025 twinlife SA.
+ *  Copyright (c) 2013-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -80,6 +80,14 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 /**
  * <pre>
+ * Database Version 27
+ *  Date: 2026/10/18
+ *   Add the imageCache table to index the image files downloaded in the cache directory.
+ *
+ * Database Version 26
+ *  Date: 2026/10/18
+ *   Add the content table to find conversation files by their content digest.
+ *
  * Database Version 25
  *  Date: 2024/10/14
  *   Fix twincodeOutbound flags after introduction of beta support for SDPs encryption keys (internal version).
@@ -277,16 +285,20 @@ static const int ddLogLevel = DDLogLevelWarning;
  * </pre>
  */
 
-#define DATABASE_VERSION 25
+#define DATABASE_VERSION 27
 
 static NSTimeInterval MIN_DISCONNECTED_TIMEOUT = 16; // s
 static NSTimeInterval MAX_DISCONNECTED_TIMEOUT = 512; // s
+static long MAX_SERVICE_TIMEOUT = 30000; // ms
 //static NSTimeInterval MIN_CONNECTED_TIMEOUT = 64; // s
 //static NSTimeInterval NO_RECONNECTION_TIMEOUT = 0; // s
 static NSTimeInterval MIN_RECONNECTION_TIMEOUT = 1; // s
 //static NSTimeInterval MAX_RECONNECTION_TIMEOUT = 8; // s
 //static NSTimeInterval CONNECTING_TIMEOUT = 10; // s
 
+// Maximum number of threads that de-serialize the packets received from the server.
+#define MAX_DECODE_WORKERS 4
+
 static TLTwinlife *sharedTwinlife;
 static atomic_ullong requestId;
 static TLBinaryPacketIQSerializer *IQ_ON_ERROR_SERIALIZER_INSTANCE = nil;
@@ -428,6 +440,63 @@ static TLBinaryPacketIQSerializer *IQ_ON_ERROR_SERIALIZER_INSTANCE = nil;
 
 @end
 
+//
+// Interface: TLReceivedPacket
+//
+
+/// A packet received from the server which is waiting to be de-serialized and given to its listener.
+/// Packets are de-serialized in parallel but the listeners are called in the order the packets are received.
+@interface TLReceivedPacket : NSObject
+
+@property (readonly, nonnull) TLBinaryDecoder *decoder;
+@property (readonly, nonnull) TLSerializer *serializer;
+@property (readonly, nonnull) TLBinaryPacketListener listener;
+@property (readonly, nonnull) NSUUID *schemaId;
+@property (nullable) TLBinaryPacketIQ *iq;
+@property BOOL decoded;
+
+- (nonnull instancetype)initWithDecoder:(nonnull TLBinaryDecoder *)decoder serializer:(nonnull TLSerializer *)serializer listener:(nonnull TLBinaryPacketListener)listener schemaId:(nonnull NSUUID *)schemaId;
+
+@end
+
+//
+// Implementation: TLReceivedPacket
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLReceivedPacket"
+
+@implementation TLReceivedPacket
+
+- (nonnull instancetype)initWithDecoder:(nonnull TLBinaryDecoder *)decoder serializer:(nonnull TLSerializer *)serializer listener:(nonnull TLBinaryPacketListener)listener schemaId:(nonnull NSUUID *)schemaId {
+    
+    self = [super init];
+    if (self) {
+        _decoder = decoder;
+        _serializer = serializer;
+        _listener = listener;
+        _schemaId = schemaId;
+        _decoded = NO;
+    }
+    return self;
+}
+
+@end
+
+//
+// Interface: TLTwinlife ()
+//
+
+@interface TLTwinlife ()
+
+/// Packet decoding state: the received packets in their order, protected by the receivedPackets lock.
+@property (readonly, nonnull) dispatch_queue_t decodeQueue;
+@property (readonly, nonnull) NSMutableArray<TLReceivedPacket *> *receivedPackets;
+@property int decodeWorkers;
+@property int startedPackets;
+
+@end
+
 //
 // Implementation: TLTwinlife
 //
@@ -582,6 +651,10 @@ static TLBinaryPacketIQSerializer *IQ_ON_ERROR_SERIALIZER_INSTANCE = nil;
         _serverQueueTag = &_serverQueueTag;
         _serverQueue = dispatch_queue_create("serverTwinlifeQueue", DISPATCH_QUEUE_SERIAL);
         dispatch_queue_set_specific(_serverQueue, _serverQueueTag, _serverQueueTag, NULL);
+        _decodeQueue = dispatch_queue_create("decodeTwinlifeQueue", DISPATCH_QUEUE_CONCURRENT);
+        _receivedPackets = [[NSMutableArray alloc] init];
+        _decodeWorkers = 0;
+        _startedPackets = 0;
 
         _model = [self getModel];
         //_connectionRetries = 0;
@@ -1277,6 +1350,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_ERROR_SERIALIZER_INSTANCE = nil;
             self.connectionMonitor = nil;
         }
     }
+    [self.connectivityService signalAll];
     [self.serverConnection triggerWorker];
 
     // Note: the call to disconnect must not be done now but later, if we are still connected
@@ -1388,13 +1462,19 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
 
             // Create a connection monitor instance dedicated to the new thread and stop a possible running connection monitor.
             TLConnectionMonitor *connectionMonitor;
+            BOOL stopMonitor;
             @synchronized (self) {
                 connectionMonitor = [[TLConnectionMonitor alloc] init];
-                if (self.connectionMonitor) {
+                stopMonitor = self.connectionMonitor != nil;
+                if (stopMonitor) {
                     self.connectionMonitor.running = NO;
                 }
                 self.connectionMonitor = connectionMonitor;
             }
+            if (stopMonitor) {
+                [self.connectivityService signalAll];
+                [self.serverConnection triggerWorker];
+            }
 
             NSThread* thread = [[NSThread alloc] initWithTarget:self selector:@selector(run:) object:connectionMonitor];
             [thread setName:@"com.twinlife.ConnectionMonitor"];
@@ -1437,6 +1517,8 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
         self.online = NO;
         atomic_store(&_twinlifeStatus, TLTwinlifeStatusStopped);
     }
+    [self.connectivityService signalAll];
+    [self.serverConnection triggerWorker];
 
     for (TLBaseService *service in self.twinlifeServices) {
         if ([service isServiceOn]) {
@@ -1660,6 +1742,8 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
 - (void)didReceiveBinaryWithData:(nonnull NSData *)data {
     DDLogVerbose(@"%@ didReceiveBinaryWithData: %@", LOG_TAG, data);
 
+    // Only look at the packet header from the connection monitor thread: the packet is de-serialized
+    // by the decode workers so that a large burst of packets does not delay the socket servicing.
     NSUUID *schemaId;
     int schemaVersion;
     @try {
@@ -1673,19 +1757,18 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
         if (!listener || !serializer) {
             DDLogError(@"%@ didReceiveBinaryData: schema unsupported: %@.%d", LOG_TAG, schemaId, schemaVersion);
         } else {
-            NSObject *object = [serializer deserializeWithSerializerFactory:self.serializerFactory decoder:binaryDecoder];
-            if (![object isKindOfClass:[TLBinaryPacketIQ class]]) {
-                DDLogError(@"%@ didReceiveBinaryData: invalid packet", LOG_TAG);
-            } else {
-                // Execute the operation handler from the server queue (so that we don't block the caller, which is the
-                // connection monitor thread, and we can give the de-serialized IQ to another thread).
-                dispatch_async(self.serverQueue, ^{
-                    @try {
-                        TLBinaryPacketIQ *iq = (TLBinaryPacketIQ *)object;
-                        listener(iq);
-                    } @catch(NSException *lException) {
-                        DDLogError(@"%@ didReceiveBinaryData: exception: %@ schemaId: %@", LOG_TAG, lException, schemaId);
-                    }
+            TLReceivedPacket *packet = [[TLReceivedPacket alloc] initWithDecoder:binaryDecoder serializer:serializer listener:listener schemaId:schemaId];
+            BOOL startWorker;
+            @synchronized (self.receivedPackets) {
+                [self.receivedPackets addObject:packet];
+                startWorker = self.decodeWorkers < MAX_DECODE_WORKERS;
+                if (startWorker) {
+                    self.decodeWorkers++;
+                }
+            }
+            if (startWorker) {
+                dispatch_async(self.decodeQueue, ^{
+                    [self decodeReceivedPackets];
                 });
             }
         }
@@ -1695,6 +1778,59 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
     }
 }
 
+- (void)decodeReceivedPackets {
+    DDLogVerbose(@"%@ decodeReceivedPackets", LOG_TAG);
+
+    while (YES) {
+        // The packets are de-serialized in the order they are received: the first packets of the
+        // queue are being de-serialized or are waiting for a previous packet before being dispatched.
+        TLReceivedPacket *packet;
+        @synchronized (self.receivedPackets) {
+            if (self.startedPackets >= self.receivedPackets.count) {
+                self.decodeWorkers--;
+                return;
+            }
+            packet = self.receivedPackets[self.startedPackets];
+            self.startedPackets++;
+        }
+
+        @try {
+            NSObject *object = [packet.serializer deserializeWithSerializerFactory:self.serializerFactory decoder:packet.decoder];
+            if (![object isKindOfClass:[TLBinaryPacketIQ class]]) {
+                DDLogError(@"%@ didReceiveBinaryData: invalid packet", LOG_TAG);
+            } else {
+                packet.iq = (TLBinaryPacketIQ *)object;
+            }
+        } @catch(NSException *lException) {
+            DDLogError(@"%@ didReceiveBinaryData: exception: %@ schemaId: %@", LOG_TAG, lException, packet.schemaId);
+        }
+
+        // Give the packets to the server queue in their arrival order: dispatch from within the lock
+        // so that two workers cannot re-order them.
+        @synchronized (self.receivedPackets) {
+            packet.decoded = YES;
+            while (self.receivedPackets.count > 0 && self.receivedPackets[0].decoded) {
+                TLReceivedPacket *first = self.receivedPackets[0];
+                [self.receivedPackets removeObjectAtIndex:0];
+                self.startedPackets--;
+
+                TLBinaryPacketIQ *iq = first.iq;
+                if (iq) {
+                    TLBinaryPacketListener listener = first.listener;
+                    NSUUID *schemaId = first.schemaId;
+                    dispatch_async(self.serverQueue, ^{
+                        @try {
+                            listener(iq);
+                        } @catch(NSException *lException) {
+                            DDLogError(@"%@ didReceiveBinaryData: exception: %@ schemaId: %@", LOG_TAG, lException, schemaId);
+                        }
+                    });
+                }
+            }
+        }
+    }
+}
+
 #pragma mark - Private methods
 
 - (BOOL)needInstall {
@@ -2151,19 +2287,25 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
         monitor.running = NO;
     }
 
+    // The monitor thread blocks on a single wakeup source at a time and it is signaled when there is something to do:
+    // - while the network is not connected, it waits on the connectivity service which is signaled by reachability
+    //   changes, `connect` and the shutdown (the timeout is only a safety net if a reachability change is missed),
+    // - while the network is connected, it waits in `serviceWithTimeout` which returns on websocket events and
+    //   `triggerWorker` (outbound messages, connect, disconnect, shutdown) or when the reconnection delay expires
+    //   (the server connection bounds that delay to 5s).
     NSTimeInterval disconnectedTimeout = 0.1;
     while (monitor.running) {
+        BOOL networkLost = NO;
         do {
             DDLogInfo(@"%@ %@", LOG_TAG, @"wait for connected network...");
 
-            // If we have some active P2P session, reduce the disconnect timeout to 1s when it is below 16.
-            // In that case, we will use 1, 2s, 4s, 8s network detection timeout.
+            // With an active P2P session, check the network every 100ms because the audio/video is lost.
             if ([self.jobService isVoIPActive]) {
                 disconnectedTimeout = 0.1;
             } else if (![self.jobService isIdle]) {
-                // If we are not idle (app in foreground), be more pro-active in testing the network connectivity.
-                // The delay will start at 0 and we increase it by 250ms min until we reach 10s and then we start
-                // again from 1s.
+                // If we are not idle (app in foreground), keep the pro-active check of the network connectivity
+                // in case a reachability change is missed.  The delay will start at 0 and we increase it by 250ms
+                // min until we reach 10s and then we start again from 1s.
                 // 0, 250, 625, 1187, 2030, 3305, 5207, 8060
                 disconnectedTimeout = 0.25 + (disconnectedTimeout / 2.0);
                 if (disconnectedTimeout > 10.0) {
@@ -2173,6 +2315,7 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
             if (![self.connectivityService waitForConnectedNetworkWithTimeout:disconnectedTimeout]) {
                 DDLogInfo(@"%@ %@", LOG_TAG, @"network not connected");
 
+                networkLost = YES;
                 disconnectedTimeout *= 2;
                 if (disconnectedTimeout > MAX_DISCONNECTED_TIMEOUT) {
                     disconnectedTimeout = MAX_DISCONNECTED_TIMEOUT;
@@ -2180,11 +2323,24 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
             }
         } while (![self.connectivityService isConnectedNetwork] && monitor.running);
 
+        // The reconnection delay was computed for the previous network, connect immediately on the new one.
+        if (networkLost) {
+            self.serverConnection.reconnectionTime = 0;
+        }
+
         // Do not try to re-connect if we are disconnecting.
         BOOL hasLock = NO;
         if (![self.serverConnection isDisconnecting]) {
 
             while (monitor.running && [self.connectivityService isConnectedNetwork]) {
+                if (![self isConnected] && ![self.serverConnection isConnecting]) {
+                    // Wait for the reconnection delay given by the last error, a call to `connect` cancels it.
+                    int64_t delay = (self.serverConnection.reconnectionTime - [TLTwinlife timestamp]) / 1000000LL;
+                    if (delay > 0) {
+                        [self.serverConnection serviceWithTimeout:(long)MIN(delay, MAX_SERVICE_TIMEOUT)];
+                        continue;
+                    }
+                }
                 if (![self isConnected] && monitor.running) {
                     hasLock = [self lockServerConnection];
                     if (hasLock) {
@@ -2200,7 +2356,7 @@ static void darwinNotificationObserver(CFNotificationCenterRef center, void *obs
                         }
                     }
                 }
-                [self.serverConnection serviceWithTimeout:5000];
+                [self.serverConnection serviceWithTimeout:[self.serverConnection serviceTimeoutWithMax:MAX_SERVICE_TIMEOUT]];
             }
 
             [self unlockServerConnection];
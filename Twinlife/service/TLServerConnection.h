@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2023-2025 twinlife SA.
+ *  Copyright (c) 2023-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -14,6 +14,20 @@
 @class TLProxyDescriptor;
 @class TLTwinlifeConfiguration;
 
+/// Priority of a message sent to the server:
+/// - interactive messages (call signaling) are given to the websocket immediately,
+/// - normal messages are sent before the bulk messages (image upload, logs, assertions)
+///   which can only use a part of the websocket write capacity.
+typedef enum {
+    TLServerPriorityInteractive,
+    TLServerPriorityNormal,
+    TLServerPriorityBulk
+} TLServerPriority;
+
+/// Called when a message accepted by sendWithData is dropped because the connection was closed
+/// before it was given to the websocket.
+typedef void (^TLServerMessageDropped) (void);
+
 @protocol TLServerConnectionDelegate
 
 /// Called when we are connected to the server.
@@ -75,8 +89,21 @@
 /// Returns YES if the message was put on the write queue and NO if we are not connected.
 - (BOOL)sendWithData:(nonnull NSData *)message;
 
+/// Send the binary data message to the server with the given priority.
+/// Returns YES if the message was put on the write queue and NO if we are not connected.
+- (BOOL)sendWithData:(nonnull NSData *)message priority:(TLServerPriority)priority;
+
+/// Send the binary data message to the server with the given priority.
+/// Returns YES if the message was put on the write queue and NO if we are not connected.
+/// The `dropped` block is called if the message is still queued when the connection is closed.
+- (BOOL)sendWithData:(nonnull NSData *)message priority:(TLServerPriority)priority dropped:(nullable TLServerMessageDropped)dropped;
+
 - (void)serviceWithTimeout:(long)timeout;
 
+/// Get the time in milliseconds the service thread can block in `serviceWithTimeout` before it has
+/// something to do by itself (reconnection delay, queued messages), bounded by `maxTimeout`.
+- (long)serviceTimeoutWithMax:(long)maxTimeout;
+
 /// Get the statistics about connection errors.
 - (nonnull TLErrorStats *)errorStats;
 
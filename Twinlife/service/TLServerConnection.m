@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2023-2025 twinlife SA.
+ *  Copyright (c) 2023-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -27,6 +27,57 @@ static const int ddLogLevel = DDLogLevelWarning;
 #define PROXY_START_DELAY        (((5000 / 8) << 12) & 0x003FF000)  // around 5000ms, see wscontainer.h in libwebsockets
 #define PROXY_FIRST_START_DELAY  (((500 / 8) << 22) & 0x7FC00000)   // around 500ms
 
+// Number of bytes given to the websocket until it tells us it is writable again or until the next service tick.
+#define MAX_WRITE_BURST          (64 * 1024)
+
+// Number of normal messages sent for one bulk message when both lanes are not empty.
+#define NORMAL_LANE_WEIGHT       4
+
+// Max time the service thread blocks while messages are queued: the write budget is refilled on each
+// service tick because we don't rely on the websocket layer to report onWritable.
+#define WRITE_TICK_DELAY         0.010 // s
+
+// Maximum delay before a reconnection, this is the cadence at which the connection monitor used to retry.
+#define MAX_RECONNECTION_DELAY   5000 // ms
+
+// Connect time assumed for a proxy we never used and cost of a proxy failure
+// (we wait PROXY_START_DELAY before trying the next proxy).
+#define PROXY_DEFAULT_CONNECT_TIME  1000 // ms
+#define PROXY_FAILURE_COST          5000 // ms
+
+// Halve the proxy counters when they reach this value so that the score follows network changes.
+#define PROXY_SCORE_MAX_COUNT       32
+
+// Halve the weight of the proxy failures each time this delay elapsed since the last failure.
+#define PROXY_FAILURE_HALF_LIFE     (24 * 3600 * 1000L) // ms
+
+//
+// Interface: TLServerMessage
+//
+
+@interface TLServerMessage : NSObject
+
+@property (readonly, nonnull) NSData *data;
+@property (readonly, nullable) TLServerMessageDropped dropped;
+
+- (nonnull instancetype)initWithData:(nonnull NSData *)data dropped:(nullable TLServerMessageDropped)dropped;
+
+@end
+
+@implementation TLServerMessage
+
+- (nonnull instancetype)initWithData:(nonnull NSData *)data dropped:(nullable TLServerMessageDropped)dropped {
+
+    self = [super init];
+    if (self) {
+        _data = data;
+        _dropped = dropped;
+    }
+    return self;
+}
+
+@end
+
 @interface TLSocketProxyDescriptor ()
 
 - (nonnull instancetype)initWithHostname:(nonnull NSString *)hostname port:(int)port customSNI:(nullable NSString *)customSNI;
@@ -63,8 +114,102 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 @end
 
+//
+// Interface: TLProxyScore
+//
+
+/// Connection results for a proxy, kept across sessions to try first the proxies which are expected to connect faster.
+@interface TLProxyScore : NSObject
+
+@property int successCount;
+@property int failureCount;
+@property int64_t connectTime;
+@property int64_t lastFailureTime;
+
+- (nonnull instancetype)initWithValues:(nullable NSArray<NSNumber *> *)values;
+
+- (nonnull NSArray<NSNumber *> *)values;
+
+/// Expected time to connect through the proxy taking into account the chance of failure.
+/// The failures are forgotten progressively when the proxy did not fail since a long time.
+- (double)expectedConnectTimeWithNow:(int64_t)now;
+
+- (void)recordSuccessWithConnectTime:(int64_t)connectTime;
+
+- (void)recordFailureWithTime:(int64_t)now;
+
+@end
+
+@implementation TLProxyScore
+
+- (nonnull instancetype)initWithValues:(nullable NSArray<NSNumber *> *)values {
+    
+    self = [super init];
+    if (self) {
+        if (values && values.count == 4) {
+            _successCount = values[0].intValue;
+            _failureCount = values[1].intValue;
+            _connectTime = values[2].longLongValue;
+            _lastFailureTime = values[3].longLongValue;
+        } else {
+            _connectTime = PROXY_DEFAULT_CONNECT_TIME;
+        }
+    }
+    return self;
+}
+
+- (nonnull NSArray<NSNumber *> *)values {
+    
+    return @[[NSNumber numberWithInt:self.successCount], [NSNumber numberWithInt:self.failureCount], [NSNumber numberWithLongLong:self.connectTime], [NSNumber numberWithLongLong:self.lastFailureTime]];
+}
+
+- (double)expectedConnectTimeWithNow:(int64_t)now {
+    
+    // Halve the weight of the failures for each PROXY_FAILURE_HALF_LIFE elapsed since the last failure.
+    double failures = self.failureCount;
+    if (failures > 0 && now > self.lastFailureTime) {
+        failures = failures / pow(2.0, (double)(now - self.lastFailureTime) / PROXY_FAILURE_HALF_LIFE);
+    }
+
+    // Laplace estimate of the success probability so that unknown proxies are still tried.
+    double p = (self.successCount + 1.0) / (self.successCount + failures + 2.0);
+    return (double)self.connectTime + ((1.0 - p) / p) * PROXY_FAILURE_COST;
+}
+
+- (void)recordSuccessWithConnectTime:(int64_t)connectTime {
+    
+    if (self.successCount == 0) {
+        self.connectTime = connectTime;
+    } else {
+        self.connectTime = (3 * self.connectTime + connectTime) / 4;
+    }
+    self.successCount++;
+    [self decay];
+}
+
+- (void)recordFailureWithTime:(int64_t)now {
+    
+    self.failureCount++;
+    self.lastFailureTime = now;
+    [self decay];
+}
+
+- (void)decay {
+    
+    if (self.successCount + self.failureCount >= PROXY_SCORE_MAX_COUNT) {
+        self.successCount = self.successCount / 2;
+        self.failureCount = self.failureCount / 2;
+    }
+}
+
+@end
+
 @interface TLServerConnection () <TLWebSocketDelegate>
 
+/// The websocket container is created once and kept for the life of the server connection
+/// so that, if the container caches the TLS client sessions (per host, port and SNI), the
+/// reconnections can use an abbreviated handshake.  For the same reason, the pseudo random
+/// SNI of our SNI proxies is generated once and not for each connection.
 @property (readonly, nonnull) TLWebSocketContainer *container;
 @property (readonly, nonnull) id<TLServerConnectionDelegate> delegate;
 @property (readonly, nonnull) NSString *hostName;
@@ -94,14 +239,38 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property long certificatErrorCount;
 @property long proxyErrorCount;
 @property atomic_int connecting;
-@property int64_t shuffledDeadline;
+@property (nonnull) NSMutableDictionary<NSString *, TLProxyScore *> *proxyScores;
+@property (readonly, nonnull) NSMutableArray<TLServerMessage *> *normalLane;
+@property (readonly, nonnull) NSMutableArray<TLServerMessage *> *bulkLane;
+@property long writeBudget;
+@property int normalCredit;
 
 /// Generate a random SNI out of a list of hosts, domain, TLDs.
 + (nonnull NSString *)createSNIWithList:(nonnull NSArray<NSString *> *)hostList domainList:(nonnull NSArray<NSString *> *)domainList tldList:(nonnull NSArray<NSString *> *)tldList;
 
-/// Setup a new list of random proxies if needed.
+/// Setup the list of proxies to try, ordered by their expected connect time.
 - (void)setupProxiesWithLastProxy:(nullable TLProxyDescriptor *)lastProxy;
 
+/// Get the key used to store the score of the proxy.
++ (nonnull NSString *)scoreKeyWithProxy:(nonnull TLProxyDescriptor *)proxy;
+
+/// Get the score of the proxy, creating it when necessary (must be called with the lock).
+- (nonnull TLProxyScore *)scoreWithProxy:(nonnull TLProxyDescriptor *)proxy;
+
+/// Record the connection results for the proxies we tried and save the scores of the
+/// configured proxies, the others are forgotten (must be called with the lock).
+- (void)recordWithStats:(nonnull NSArray<TLConnectionStats *> *)stats active:(int)active;
+
+/// Give the queued normal and bulk messages to the websocket within the write budget (must be called with the lock).
+- (void)drainLanes;
+
+/// Drop the queued messages when the websocket is closed (must be called with the lock).
+/// Returns the dropped messages so that they are reported to their sender once the lock is released.
+- (nullable NSArray<TLServerMessage *> *)clearLanes;
+
+/// Report the dropped messages to their sender (must be called without the lock).
+- (void)droppedWithMessages:(nullable NSArray<TLServerMessage *> *)messages;
+
 @end
 
 @implementation TLErrorStats
@@ -165,9 +334,12 @@ static const int ddLogLevel = DDLogLevelWarning;
         _isConnected = NO;
         _disconnecting = NO;
         _activeProxy = nil;
-        _shuffledDeadline = 0;
         _shuffledProxies = nil;
         _lastProxy = nil;
+        _normalLane = [[NSMutableArray alloc] init];
+        _bulkLane = [[NSMutableArray alloc] init];
+        _writeBudget = MAX_WRITE_BURST;
+        _normalCredit = NORMAL_LANE_WEIGHT;
         
         // Separate the Keyed proxies vs the SNI ones.
         NSArray<TLProxyDescriptor *> *proxies = connectivityService.proxyDescriptors;
@@ -213,6 +385,15 @@ static const int ddLogLevel = DDLogLevelWarning;
         }
         _shuffledProxyCount = count;
         _shuffledProxies = [[NSMutableArray alloc] initWithCapacity:_shuffledProxyCount];
+
+        _proxyScores = [[NSMutableDictionary alloc] init];
+        NSDictionary<NSString *, NSArray<NSNumber *> *> *scores = [connectivityService loadProxyScores];
+        for (NSString *key in scores) {
+            NSArray<NSNumber *> *values = scores[key];
+            if ([values isKindOfClass:[NSArray class]]) {
+                _proxyScores[key] = [[TLProxyScore alloc] initWithValues:values];
+            }
+        }
     }
     return self;
 }
@@ -220,18 +401,12 @@ static const int ddLogLevel = DDLogLevelWarning;
 - (void)setupProxiesWithLastProxy:(nullable TLProxyDescriptor *)lastProxy {
     DDLogVerbose(@"%@ setupProxiesWithLastProxy: %@", LOG_TAG, lastProxy);
     
-    // Shuffle the proxy descriptors randomly each 4 hours and try to get one keyed proxy
-    // followed by one SNI proxy to increase the chance to try different proxy modes.
-    // However, if the last proxy was changed, re-build the list.
-    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
-    if ((now < self.shuffledDeadline || self.shuffledProxyCount == 0) && lastProxy == self.lastProxy) {
-        return;
-    }
-    
-    self.shuffledDeadline = now + (3 * 3600L * 1000L) + arc4random_uniform(4L * 3600L * 1000L);
+    // Select the proxies with the best expected connect time and alternate one keyed proxy
+    // with one SNI proxy to increase the chance to try different proxy modes.  The lists are
+    // shuffled before being sorted so that proxies with the same score are tried in random order.
     self.lastProxy = lastProxy;
-    NSMutableArray<TLKeyProxyDescriptor *> *ksList = [[NSMutableArray alloc] initWithArray:self.keyProxies];
-    NSMutableArray<TLSNIProxyDescriptor *> *sList = [[NSMutableArray alloc] initWithArray:self.sniProxies];
+    NSMutableArray<TLProxyDescriptor *> *ksList = [[NSMutableArray alloc] initWithArray:self.keyProxies];
+    NSMutableArray<TLProxyDescriptor *> *sList = [[NSMutableArray alloc] initWithArray:self.sniProxies];
     
     // Remove the last proxy that will be tried as first proxy from the list (to make sure we don't make another connection to it).
     if (lastProxy) {
@@ -252,18 +427,45 @@ static const int ddLogLevel = DDLogLevelWarning;
             }
         }
     }
+
+    // Take a snapshot of the expected connect times: the scores are updated with the lock held.
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    NSMutableDictionary<NSString *, NSNumber *> *times = [[NSMutableDictionary alloc] init];
+    @synchronized (self) {
+        for (NSArray<TLProxyDescriptor *> *list in @[ksList, sList]) {
+            for (TLProxyDescriptor *proxy in list) {
+                NSString *key = [TLServerConnection scoreKeyWithProxy:proxy];
+                TLProxyScore *score = self.proxyScores[key];
+                times[key] = [NSNumber numberWithDouble:score ? [score expectedConnectTimeWithNow:now] : PROXY_DEFAULT_CONNECT_TIME + PROXY_FAILURE_COST];
+            }
+        }
+    }
+    NSComparator compareScore = ^NSComparisonResult(TLProxyDescriptor *proxy1, TLProxyDescriptor *proxy2) {
+        double time1 = times[[TLServerConnection scoreKeyWithProxy:proxy1]].doubleValue;
+        double time2 = times[[TLServerConnection scoreKeyWithProxy:proxy2]].doubleValue;
+        return time1 < time2 ? NSOrderedAscending : (time1 > time2 ? NSOrderedDescending : NSOrderedSame);
+    };
+
+    // Sort each group separately and then interleave them: the group whose best proxy is
+    // expected to connect faster is used first.
+    for (NSMutableArray<TLProxyDescriptor *> *list in @[ksList, sList]) {
+        for (int i = (int) list.count - 1; i >= 1; i--) {
+            [list exchangeObjectAtIndex:i withObjectAtIndex:arc4random_uniform(i + 1)];
+        }
+        [list sortWithOptions:NSSortStable usingComparator:compareScore];
+    }
+    int keyedFirst = (ksList.count > 0 && sList.count > 0 && compareScore(ksList[0], sList[0]) == NSOrderedAscending) ? 1 : 0;
+
     [self.shuffledProxies removeAllObjects];
-    for (int i = 0; i < self.shuffledProxyCount; i++) {
+    for (int i = keyedFirst; i < self.shuffledProxyCount + keyedFirst; i++) {
         TLProxyDescriptor *proxy = nil;
         if (ksList.count > 0 && ((i & 0x01) != 0 || sList.count == 0)) {
-            int idx = (int) arc4random_uniform((uint32_t)ksList.count);
-            proxy = ksList[idx];
-            [ksList removeObjectAtIndex:idx];
+            proxy = ksList[0];
+            [ksList removeObjectAtIndex:0];
         }
         if (sList.count > 0 && ((i & 0x01) == 0 || !proxy)) {
-            int idx = (int) arc4random_uniform((uint32_t)sList.count);
-            proxy = sList[idx];
-            [sList removeObjectAtIndex:idx];
+            proxy = sList[0];
+            [sList removeObjectAtIndex:0];
         }
         if (proxy) {
             [self.shuffledProxies addObject:proxy];
@@ -271,6 +473,63 @@ static const int ddLogLevel = DDLogLevelWarning;
     }
 }
 
++ (nonnull NSString *)scoreKeyWithProxy:(nonnull TLProxyDescriptor *)proxy {
+
+    return [NSString stringWithFormat:@"%@%@", [proxy isKindOfClass:[TLKeyProxyDescriptor class]] ? @"k:" : @"s:", proxy];
+}
+
+- (nonnull TLProxyScore *)scoreWithProxy:(nonnull TLProxyDescriptor *)proxy {
+
+    NSString *key = [TLServerConnection scoreKeyWithProxy:proxy];
+    TLProxyScore *score = self.proxyScores[key];
+    if (!score) {
+        score = [[TLProxyScore alloc] initWithValues:nil];
+        self.proxyScores[key] = score;
+    }
+    return score;
+}
+
+- (void)recordWithStats:(nonnull NSArray<TLConnectionStats *> *)stats active:(int)active {
+    DDLogVerbose(@"%@ recordWithStats: %@ active: %d", LOG_TAG, stats, active);
+
+    // The first stats is for the direct connection and the next ones are for self.proxies.
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    BOOL updated = NO;
+    for (int i = 1; i < stats.count; i++) {
+        if (i - 1 < self.proxies.count) {
+            TLConnectionStats *st = stats[i];
+            TLProxyScore *score = [self scoreWithProxy:self.proxies[i - 1]];
+            if (i == active) {
+                [score recordSuccessWithConnectTime:st.txnResponseTime / 1000];
+                updated = YES;
+            } else if (st.lastError != TLConnectionErrorNone) {
+                [score recordFailureWithTime:now];
+                updated = YES;
+            }
+        }
+    }
+    if (!updated) {
+        return;
+    }
+
+    // Forget the scores of the proxies which are no longer configured.
+    NSMutableSet<NSString *> *keys = [[NSMutableSet alloc] init];
+    for (NSArray<TLProxyDescriptor *> *list in @[self.keyProxies, self.sniProxies, self.proxies]) {
+        for (TLProxyDescriptor *proxy in list) {
+            [keys addObject:[TLServerConnection scoreKeyWithProxy:proxy]];
+        }
+    }
+    NSMutableDictionary<NSString *, NSArray<NSNumber *> *> *scores = [[NSMutableDictionary alloc] initWithCapacity:keys.count];
+    for (NSString *key in [self.proxyScores allKeys]) {
+        if ([keys containsObject:key]) {
+            scores[key] = [self.proxyScores[key] values];
+        } else {
+            [self.proxyScores removeObjectForKey:key];
+        }
+    }
+    [self.connectivityService saveProxyScores:scores];
+}
+
 - (BOOL)isConnecting {
     DDLogVerbose(@"%@ isConnecting (session: %ld)", LOG_TAG, self.sessionId);
     
@@ -393,6 +652,7 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogInfo(@"%@ disconnecting session %ld from %@", LOG_TAG, self.sessionId, self.hostName);
     BOOL wasConnected;
     TLWebSocket *session;
+    NSArray<TLServerMessage *> *dropped;
     @synchronized (self) {
         session = self.session;
         wasConnected = self.isConnected;
@@ -401,7 +661,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         self.connecting = NO;
         self.isConnected = NO;
         self.activeProxy = nil;
+        dropped = [self clearLanes];
     }
+    [self droppedWithMessages:dropped];
     if (session) {
         [session close];
     } else {
@@ -414,13 +676,93 @@ static const int ddLogLevel = DDLogLevelWarning;
 - (BOOL)sendWithData:(NSData *)message {
     DDLogVerbose(@"%@ sendWithData: %lu", LOG_TAG, message.length);
     
+    return [self sendWithData:message priority:TLServerPriorityNormal dropped:nil];
+}
+
+- (BOOL)sendWithData:(nonnull NSData *)message priority:(TLServerPriority)priority {
+    DDLogVerbose(@"%@ sendWithData: %lu priority: %d", LOG_TAG, message.length, priority);
+
+    return [self sendWithData:message priority:priority dropped:nil];
+}
+
+- (BOOL)sendWithData:(nonnull NSData *)message priority:(TLServerPriority)priority dropped:(nullable TLServerMessageDropped)dropped {
+    DDLogVerbose(@"%@ sendWithData: %lu priority: %d", LOG_TAG, message.length, priority);
+    
     // Protect the sendWithMessage because it can be called by any thread (PeerConnectionService)
     // while another thread is closing the session.
     @synchronized (self) {
-        if (self.session) {
+        if (!self.session) {
+            return NO;
+        }
+
+        // Interactive messages must not wait behind a burst of image chunks or logs.
+        if (priority == TLServerPriorityInteractive) {
             return [self.session sendWithMessage:message binary:YES];
+        }
+
+        TLServerMessage *item = [[TLServerMessage alloc] initWithData:message dropped:dropped];
+        if (priority == TLServerPriorityBulk) {
+            [self.bulkLane addObject:item];
         } else {
-            return NO;
+            [self.normalLane addObject:item];
+        }
+        [self drainLanes];
+        if (self.normalLane.count == 0 && self.bulkLane.count == 0) {
+            return YES;
+        }
+    }
+
+    // Some messages are waiting for the websocket: wake up the service thread so that it
+    // refills the write budget on its next tick.
+    [self triggerWorker];
+    return YES;
+}
+
+- (void)drainLanes {
+    DDLogVerbose(@"%@ drainLanes", LOG_TAG);
+
+    while (self.session && self.writeBudget > 0 && (self.normalLane.count > 0 || self.bulkLane.count > 0)) {
+        // Weighted round robin: a bulk message is sent after NORMAL_LANE_WEIGHT normal messages.
+        NSMutableArray<TLServerMessage *> *lane;
+        if (self.bulkLane.count == 0 || (self.normalLane.count > 0 && self.normalCredit > 0)) {
+            lane = self.normalLane;
+            if (self.bulkLane.count > 0) {
+                self.normalCredit--;
+            }
+        } else {
+            lane = self.bulkLane;
+            self.normalCredit = NORMAL_LANE_WEIGHT;
+        }
+
+        TLServerMessage *message = lane[0];
+        [lane removeObjectAtIndex:0];
+        self.writeBudget -= message.data.length;
+        [self.session sendWithMessage:message.data binary:YES];
+    }
+}
+
+- (nullable NSArray<TLServerMessage *> *)clearLanes {
+    DDLogVerbose(@"%@ clearLanes", LOG_TAG);
+
+    NSMutableArray<TLServerMessage *> *dropped = nil;
+    if (self.normalLane.count > 0 || self.bulkLane.count > 0) {
+        dropped = [[NSMutableArray alloc] initWithArray:self.normalLane];
+        [dropped addObjectsFromArray:self.bulkLane];
+        [self.normalLane removeAllObjects];
+        [self.bulkLane removeAllObjects];
+    }
+    self.writeBudget = MAX_WRITE_BURST;
+    self.normalCredit = NORMAL_LANE_WEIGHT;
+    return dropped;
+}
+
+- (void)droppedWithMessages:(nullable NSArray<TLServerMessage *> *)messages {
+    DDLogVerbose(@"%@ droppedWithMessages: %lu", LOG_TAG, (unsigned long)messages.count);
+
+    // The messages were accepted by sendWithData but never given to the websocket: tell the senders.
+    for (TLServerMessage *message in messages) {
+        if (message.dropped) {
+            message.dropped();
         }
     }
 }
@@ -429,6 +771,30 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogVerbose(@"%@ serviceWithTimeout: %ld", LOG_TAG, timeout);
     
     [self.container serviceWithTimeout:(int)timeout];
+
+    // The websocket had a chance to write what we gave it: refill the write budget on each tick.
+    @synchronized (self) {
+        self.writeBudget = MAX_WRITE_BURST;
+        [self drainLanes];
+    }
+}
+
+- (long)serviceTimeoutWithMax:(long)maxTimeout {
+    DDLogVerbose(@"%@ serviceTimeoutWithMax: %ld", LOG_TAG, maxTimeout);
+
+    long timeout = maxTimeout;
+    @synchronized (self) {
+        if (!self.isConnected && !self.connecting) {
+            int64_t delay = (self.reconnectionTime - [TLTwinlife timestamp]) / 1000000LL;
+            if (delay < timeout) {
+                timeout = delay > 0 ? (long)delay : 0;
+            }
+        }
+        if ((self.normalLane.count > 0 || self.bulkLane.count > 0) && timeout > WRITE_TICK_DELAY * 1000) {
+            timeout = (long)(WRITE_TICK_DELAY * 1000);
+        }
+    }
+    return timeout;
 }
 
 - (nonnull TLErrorStats *)errorStats {
@@ -503,6 +869,7 @@ static const int ddLogLevel = DDLogLevelWarning;
                 proxyDescriptor = self.proxies[self.currentStats.proxyIndex];
                 proxyDescriptor.proxyStatus = self.currentStats.lastError;
             }
+            [self recordWithStats:stats active:active];
         } else {
             self.currentStats = nil;
         }
@@ -519,6 +886,7 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogVerbose(@"%@ onClose: %@", LOG_TAG, websocket);
     
     DDLogInfo(@"%@ session %ld connection to %@ closed", LOG_TAG, self.sessionId, self.hostName);
+    NSArray<TLServerMessage *> *dropped;
     @synchronized (self) {
         self.session = nil;
         self.connecting = NO;
@@ -526,7 +894,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         self.currentStats = nil;
         self.disconnecting = YES;
         self.activeProxy = nil;
+        dropped = [self clearLanes];
     }
+    [self droppedWithMessages:dropped];
     
     [self.delegate onDisconnectWithError:TLConnectionErrorNone];
 
@@ -548,6 +918,7 @@ static const int ddLogLevel = DDLogLevelWarning;
     
     DDLogInfo(@"%@ session %ld connection to %@ failed: %d", LOG_TAG, self.sessionId, self.hostName, error);
 
+    NSArray<TLServerMessage *> *dropped;
     @synchronized (self) {
         self.connecting = NO;
         self.isConnected = NO;
@@ -556,6 +927,7 @@ static const int ddLogLevel = DDLogLevelWarning;
         self.session = nil;
         self.activeProxy = nil;
         self.disconnecting = YES;
+        dropped = [self clearLanes];
         switch (error) {
             case TLConnectionErrorNone:
                 break;
@@ -587,13 +959,15 @@ static const int ddLogLevel = DDLogLevelWarning;
         }
         // Record the status of proxy errors.
         for (int i = 1; i < stats.count; i++) {
-            if (i - 1 <= self.proxies.count) {
+            if (i - 1 < self.proxies.count) {
                 TLConnectionStats *st = stats[i];
                 TLProxyDescriptor *proxyDescriptor = self.proxies[i - 1];
                 proxyDescriptor.proxyStatus = st.lastError;
             }
         }
+        [self recordWithStats:stats active:-1];
     }
+    [self droppedWithMessages:dropped];
     
     // Reconnect after a delay that depends on the error we got.
     // A random delay is added to make sure devices will not reconnect at the same time
@@ -601,8 +975,9 @@ static const int ddLogLevel = DDLogLevelWarning;
     int64_t timeout;
     switch (error) {
         case TLConnectionErrorNone:
-            // Connection was closed by us or by the server.
-            timeout = 500 + arc4random_uniform(8000);
+            // Connection was closed by us, by the server or after a network change: keep the reconnection
+            // within MAX_RECONNECTION_DELAY but still spread the devices over a random delay.
+            timeout = 500 + arc4random_uniform(MAX_RECONNECTION_DELAY - 500);
             break;
             
         case TLConnectionErrorDNS:
@@ -637,6 +1012,11 @@ static const int ddLogLevel = DDLogLevelWarning;
 - (void)onWritable:(nonnull TLWebSocket *)websocket {
     DDLogVerbose(@"%@ onWritable: %@", LOG_TAG, websocket);
 
+    // Refill the budget earlier than the next service tick when the websocket layer reports it.
+    @synchronized (self) {
+        self.writeBudget = MAX_WRITE_BURST;
+        [self drainLanes];
+    }
 }
 
 @end
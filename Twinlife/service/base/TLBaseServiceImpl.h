@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2024 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -41,11 +41,50 @@ static NSString * _Nonnull SERVICE_NAMES[] = {
 
 @property (readonly) int64_t requestId;
 @property (readonly) BOOL isBinary;
+@property int64_t deadline;
+@property int wheelSlot;
 
 - (nonnull instancetype)initWithRequestId:(int64_t)requestId isBinary:(BOOL)isBinary;
 
 @end
 
+//
+// Interface: TLRequestTimeoutWheel
+//
+
+/**
+ * Hashed timing wheel which tracks the deadline of each pending request.
+ *
+ * Requests are hashed in slots of one second according to their deadline (a monotonic time given by `TLTwinlife timestamp`).
+ * A request whose deadline is beyond one turn of the wheel stays in its slot until the wheel comes back to it
+ * and its deadline has passed.  Adding, removing and expiring a request is done in constant time.
+ *
+ * The wheel is not thread safe: it is protected by the owner's lock.
+ */
+@interface TLRequestTimeoutWheel : NSObject
+
+- (nonnull instancetype)init;
+
+/// Get the number of pending requests.
+- (NSUInteger)count;
+
+/// Add the request with its deadline, a previous request with the same requestId is replaced.
+- (void)addRequest:(nonnull TLRequestInfo *)request;
+
+/// Remove the pending request and return YES if it was found.
+- (BOOL)removeRequestId:(int64_t)requestId;
+
+/// Remove and return the requests whose deadline has passed.
+- (nullable NSArray<TLRequestInfo *> *)expireWithTime:(int64_t)now;
+
+/// Remove and return every pending request.
+- (nullable NSArray<TLRequestInfo *> *)removeAll;
+
+/// Get the earliest time at which `expireWithTime` must be called or 0 if there is no pending request.
+- (int64_t)nextDeadline;
+
+@end
+
 //
 // Interface: TLBaseServiceImplConfiguration ()
 //
@@ -100,10 +139,16 @@ static NSString * _Nonnull SERVICE_NAMES[] = {
 @property atomic_int sendTimeoutCount;
 @property (readonly, nonnull) TLJobService *jobService;
 @property (nullable) TLJobId *scheduleJobId;
-@property (nullable) NSDate *nextDeadline;
-@property (nonnull) NSMutableSet<TLRequestInfo *> *pendingRequestIdList;
+@property int64_t scheduleDeadline;
+@property (readonly, nonnull) TLRequestTimeoutWheel *requestTimeouts;
+
+- (void)timeoutWithRequestIds:(nonnull NSArray<TLRequestInfo *> *)requestIds;
+
+/// Get the priority used to send the IQ to the server (normal by default).
+- (TLServerPriority)priorityWithIQ:(nonnull TLBinaryPacketIQ *)iq;
 
-- (void)timeoutWithRequestIds:(nonnull NSSet<TLRequestInfo *> *)requestIds;
+/// Called when the IQ was queued for the server but dropped because the connection was closed.
+- (void)droppedBinaryIQ:(nonnull TLBinaryPacketIQ *)iq;
 
 + (nullable TLAttributeNameValue *)deserializeWithDataInputStream:(nonnull TLDataInputStream *)dataInputStream;
 
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2025 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -40,6 +40,9 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
 
 #define DATABASE_ERROR_DELAY_GUARD (2*120*1000) // 2 minutes
 
+#define TIMEOUT_WHEEL_SIZE 64
+#define TIMEOUT_WHEEL_TICK (1000LL * 1000LL * 1000LL) // 1s in ns
+
 //
 // Implementation: TLRequestInfo
 //
@@ -75,6 +78,145 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
 
 @end
 
+//
+// Interface: TLRequestTimeoutWheel ()
+//
+
+@interface TLRequestTimeoutWheel ()
+
+@property (readonly, nonnull) NSMutableArray<NSMutableSet<TLRequestInfo *> *> *slots;
+@property (readonly, nonnull) NSMutableDictionary<NSNumber *, TLRequestInfo *> *requests;
+@property int64_t expiredTick;
+
+@end
+
+//
+// Implementation: TLRequestTimeoutWheel
+//
+
+@implementation TLRequestTimeoutWheel
+
+- (nonnull instancetype)init {
+
+    self = [super init];
+    if (self) {
+        _slots = [[NSMutableArray alloc] initWithCapacity:TIMEOUT_WHEEL_SIZE];
+        for (int i = 0; i < TIMEOUT_WHEEL_SIZE; i++) {
+            [_slots addObject:[[NSMutableSet alloc] init]];
+        }
+        _requests = [[NSMutableDictionary alloc] init];
+        _expiredTick = [TLTwinlife timestamp] / TIMEOUT_WHEEL_TICK - 1;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+
+    return self.requests.count;
+}
+
+- (void)addRequest:(nonnull TLRequestInfo *)request {
+
+    [self removeRequestId:request.requestId];
+
+    // A tick that was already expired will only be looked at after a full turn, use the next one.
+    int64_t tick = request.deadline / TIMEOUT_WHEEL_TICK;
+    if (tick <= self.expiredTick) {
+        tick = self.expiredTick + 1;
+    }
+    request.wheelSlot = (int)(tick % TIMEOUT_WHEEL_SIZE);
+    [self.slots[request.wheelSlot] addObject:request];
+    self.requests[[NSNumber numberWithLongLong:request.requestId]] = request;
+}
+
+- (BOOL)removeRequestId:(int64_t)requestId {
+
+    NSNumber *key = [NSNumber numberWithLongLong:requestId];
+    TLRequestInfo *request = self.requests[key];
+    if (!request) {
+        return NO;
+    }
+
+    [self.requests removeObjectForKey:key];
+    [self.slots[request.wheelSlot] removeObject:request];
+    return YES;
+}
+
+- (nullable NSArray<TLRequestInfo *> *)expireWithTime:(int64_t)now {
+
+    if (self.requests.count == 0) {
+        self.expiredTick = now / TIMEOUT_WHEEL_TICK - 1;
+        return nil;
+    }
+
+    // Look at each slot at most once, starting after the last expired tick.
+    int64_t nowTick = now / TIMEOUT_WHEEL_TICK;
+    int64_t tick = self.expiredTick + 1;
+    if (nowTick - tick >= TIMEOUT_WHEEL_SIZE) {
+        tick = nowTick - TIMEOUT_WHEEL_SIZE + 1;
+    }
+
+    NSMutableArray<TLRequestInfo *> *expired = nil;
+    for (; tick <= nowTick; tick++) {
+        NSMutableSet<TLRequestInfo *> *slot = self.slots[tick % TIMEOUT_WHEEL_SIZE];
+        for (TLRequestInfo *request in [slot allObjects]) {
+            if (request.deadline <= now) {
+                if (!expired) {
+                    expired = [[NSMutableArray alloc] init];
+                }
+                [expired addObject:request];
+                [slot removeObject:request];
+                [self.requests removeObjectForKey:[NSNumber numberWithLongLong:request.requestId]];
+            }
+        }
+    }
+
+    // The current tick is not finished, keep it for the next call.
+    self.expiredTick = nowTick - 1;
+    return expired;
+}
+
+- (nullable NSArray<TLRequestInfo *> *)removeAll {
+
+    if (self.requests.count == 0) {
+        return nil;
+    }
+
+    NSArray<TLRequestInfo *> *result = [self.requests allValues];
+    [self.requests removeAllObjects];
+    for (NSMutableSet<TLRequestInfo *> *slot in self.slots) {
+        [slot removeAllObjects];
+    }
+    return result;
+}
+
+- (int64_t)nextDeadline {
+
+    if (self.requests.count == 0) {
+        return 0;
+    }
+
+    // Find the first slot that contains a request for the current turn of the wheel.
+    int64_t tick = self.expiredTick + 1;
+    for (int i = 0; i < TIMEOUT_WHEEL_SIZE; i++, tick++) {
+        int64_t deadline = INT64_MAX;
+        int64_t turnEnd = (tick + 1) * TIMEOUT_WHEEL_TICK;
+        for (TLRequestInfo *request in self.slots[tick % TIMEOUT_WHEEL_SIZE]) {
+            if (request.deadline < turnEnd && request.deadline < deadline) {
+                deadline = request.deadline;
+            }
+        }
+        if (deadline != INT64_MAX) {
+            return deadline;
+        }
+    }
+
+    // Only requests for the next turns: come back when the wheel has made one turn.
+    return tick * TIMEOUT_WHEEL_TICK;
+}
+
+@end
+
 //
 // TLServiceStats
 //
@@ -594,7 +736,7 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
         _databaseFullCount = 0L;
         _databaseErrorCount = 0L;
         _jobService = [twinlife jobService];
-        _pendingRequestIdList = [[NSMutableSet alloc] init];
+        _requestTimeouts = [[TLRequestTimeoutWheel alloc] init];
         _sendCount = 0L;
         _sendErrorCount = 0L;
         _sendDisconnectedCount = 0L;
@@ -657,12 +799,9 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
     self.signIn = NO;
     self.online = NO;
 
-    NSSet<TLRequestInfo *> *timeoutRequestIds = nil;
+    NSArray<TLRequestInfo *> *timeoutRequestIds;
     @synchronized (self) {
-        if (self.pendingRequestIdList.count > 0) {
-            timeoutRequestIds = self.pendingRequestIdList;
-            self.pendingRequestIdList = [[NSMutableSet alloc] init];
-        }
+        timeoutRequestIds = [self.requestTimeouts removeAll];
         if (self.scheduleJobId) {
             [self.scheduleJobId cancel];
             self.scheduleJobId = nil;
@@ -796,7 +935,9 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
     if (self.signIn) {
         [self packetTimeout:iq.requestId timeout:timeout isBinary:YES];
         NSData *data = [iq serializeCompactWithSerializerFactory:factory];
-        if ([self.serverStream sendWithData:data]) {
+        if ([self.serverStream sendWithData:data priority:[self priorityWithIQ:iq] dropped:^{
+            [self droppedBinaryIQ:iq];
+        }]) {
             atomic_fetch_add(&_sendCount, 1);
             return;
         }
@@ -815,7 +956,9 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
 
     if (self.signIn) {
         NSData *data = [iq serializeCompactWithSerializerFactory:factory];
-        if ([self.serverStream sendWithData:data]) {
+        if ([self.serverStream sendWithData:data priority:[self priorityWithIQ:iq] dropped:^{
+            atomic_fetch_add(&self->_sendDisconnectedCount, 1);
+        }]) {
             atomic_fetch_add(&_sendCount, 1);
         } else {
             atomic_fetch_add(&_sendDisconnectedCount, 1);
@@ -825,46 +968,81 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
     }
 }
 
+- (TLServerPriority)priorityWithIQ:(nonnull TLBinaryPacketIQ *)iq {
+
+    return TLServerPriorityNormal;
+}
+
+- (void)droppedBinaryIQ:(nonnull TLBinaryPacketIQ *)iq {
+    DDLogVerbose(@"%@ droppedBinaryIQ: %lld", LOG_TAG, iq.requestId);
+
+    // The IQ was queued but the connection was closed before it was sent: fail the request now
+    // unless it was already reported (timeout or disconnect).
+    BOOL pending;
+    @synchronized (self) {
+        pending = [self.requestTimeouts removeRequestId:iq.requestId];
+        if (self.requestTimeouts.count == 0 && self.scheduleJobId) {
+            [self.scheduleJobId cancel];
+            self.scheduleJobId = nil;
+        }
+    }
+    atomic_fetch_add(&_sendDisconnectedCount, 1);
+    if (pending) {
+        [self onErrorWithErrorPacket:[[TLBinaryErrorPacketIQ alloc] initWithSerializer:[TLTwinlife IQ_ON_ERROR_SERIALIZER] requestId:iq.requestId errorCode:TLBaseServiceErrorCodeTwinlifeOffline]];
+    }
+}
+
 - (void)packetTimeout:(int64_t)requestId timeout:(NSTimeInterval)timeout isBinary:(BOOL)isBinary {
 
     TLRequestInfo *requestInfo = [[TLRequestInfo alloc] initWithRequestId:requestId isBinary:isBinary];
-    NSDate *deadline = [[NSDate alloc] initWithTimeIntervalSinceNow:timeout + TIMEOUT_CHECK_DELAY];
+    int64_t now = [TLTwinlife timestamp];
+    requestInfo.deadline = now + (int64_t)((timeout + TIMEOUT_CHECK_DELAY) * 1000000000.0);
     @synchronized (self) {
-        [self.pendingRequestIdList addObject:requestInfo];
-        self.nextDeadline = deadline;
-        if (!self.scheduleJobId) {
-            self.scheduleJobId = [self.jobService scheduleWithJob:self deadline:deadline priority:TLJobPriorityMessage];
+        [self.requestTimeouts addRequest:requestInfo];
+
+        // Re-schedule the job only when this request must expire before the one we are waiting for.
+        if (!self.scheduleJobId || requestInfo.deadline < self.scheduleDeadline) {
+            [self scheduleTimeoutJobWithTime:now];
         }
     }
 }
 
 - (void)receivedBinaryIQ:(nonnull TLBinaryPacketIQ *)iq {
     
-    TLRequestInfo *requestInfo = [[TLRequestInfo alloc] initWithRequestId:iq.requestId isBinary:YES];
     @synchronized (self) {
-        [self.pendingRequestIdList removeObject:requestInfo];
-        if (self.pendingRequestIdList.count == 0 && self.scheduleJobId) {
+        [self.requestTimeouts removeRequestId:iq.requestId];
+        if (self.requestTimeouts.count == 0 && self.scheduleJobId) {
             [self.scheduleJobId cancel];
             self.scheduleJobId = nil;
         }
     }
 }
 
+- (void)scheduleTimeoutJobWithTime:(int64_t)now {
+    DDLogVerbose(@"%@ scheduleTimeoutJobWithTime: %lld", LOG_TAG, now);
+
+    if (self.scheduleJobId) {
+        [self.scheduleJobId cancel];
+        self.scheduleJobId = nil;
+    }
+
+    int64_t deadline = [self.requestTimeouts nextDeadline];
+    if (deadline > 0) {
+        NSDate *date = [[NSDate alloc] initWithTimeIntervalSinceNow:(double)(deadline - now) / 1000000000.0];
+        self.scheduleDeadline = deadline;
+        self.scheduleJobId = [self.jobService scheduleWithJob:self deadline:date priority:TLJobPriorityMessage];
+    }
+}
+
 - (void)runJob {
     DDLogVerbose(@"%@ runJob", LOG_TAG);
 
-    NSDate *now = [NSDate date];
-    NSSet<TLRequestInfo *> *timeoutRequestIds = nil;
+    int64_t now = [TLTwinlife timestamp];
+    NSArray<TLRequestInfo *> *timeoutRequestIds;
     @synchronized (self) {
         self.scheduleJobId = nil;
-        if ([self.nextDeadline compare:now] <= NSOrderedSame) {
-            if (self.pendingRequestIdList.count > 0) {
-                timeoutRequestIds = self.pendingRequestIdList;
-                self.pendingRequestIdList = [[NSMutableSet alloc] init];
-            }
-        } else {
-            self.scheduleJobId = [self.jobService scheduleWithJob:self deadline:self.nextDeadline priority:TLJobPriorityMessage];
-        }
+        timeoutRequestIds = [self.requestTimeouts expireWithTime:now];
+        [self scheduleTimeoutJobWithTime:now];
     }
 
     // We have some requestIds for the timeout.
@@ -873,7 +1051,7 @@ static const int8_t ATTRIBUTE_NAME_UUID_VALUE = 5;
     }
 }
 
-- (void)timeoutWithRequestIds:(nonnull NSSet<TLRequestInfo *> *)requestIds {
+- (void)timeoutWithRequestIds:(nonnull NSArray<TLRequestInfo *> *)requestIds {
     DDLogVerbose(@"%@ timeoutWithRequestIds", LOG_TAG);
 
     for (TLRequestInfo *requestId in requestIds) {
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2022-2025 twinlife SA.
+ *  Copyright (c) 2022-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -385,6 +385,17 @@ static TLBinaryPacketIQSerializer *IQ_ON_SESSION_TERMINATE_SERIALIZER = nil;
     
 }
 
+- (TLServerPriority)priorityWithIQ:(nonnull TLBinaryPacketIQ *)iq {
+
+    // Only the session setup (offer, answer, ICE candidates) is latency critical: it must not wait
+    // behind image uploads or logs.  Other IQs keep their order with the messages already queued.
+    if ([iq isKindOfClass:[TLSessionInitiateIQ class]] || [iq isKindOfClass:[TLSessionAcceptIQ class]]
+        || [iq isKindOfClass:[TLSessionUpdateIQ class]] || [iq isKindOfClass:[TLTransportInfoIQ class]]) {
+        return TLServerPriorityInteractive;
+    }
+    return TLServerPriorityNormal;
+}
+
 #pragma mark - TLPeerCallService
 
 /// Create a call room with the given twincode identification.  The user must be owner of that twincode.
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2025 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -27,8 +27,10 @@
 
 - (BOOL)isConnectedNetwork;
 
+/// Block until the network is connected, a `signalAll` is made or the timeout expires.
 - (BOOL)waitForConnectedNetworkWithTimeout:(NSTimeInterval)timeout;
 
+/// Wake up the thread blocked in `waitForConnectedNetworkWithTimeout`, the wakeup is not lost if nobody is waiting yet.
 - (void)signalAll;
 
 - (void)reachabilityCallback:(SCNetworkReachabilityFlags)flags;
@@ -37,4 +39,10 @@
 
 - (void)saveLastProxyDescriptor:(nullable TLProxyDescriptor *)proxyDescriptor;
 
+/// Get the proxy connection scores saved by the server connection.
+- (nonnull NSDictionary<NSString *, NSArray<NSNumber *> *> *)loadProxyScores;
+
+/// Save the proxy connection scores so that they are used by the next connections.
+- (void)saveProxyScores:(nonnull NSDictionary<NSString *, NSArray<NSNumber *> *> *)scores;
+
 @end
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2025 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -30,6 +30,7 @@ static const int ddLogLevel = DDLogLevelWarning;
 #define WEB_SOCKET_CONNECTION_PREFERENCES_ACTIVE_PROXY_DESCRIPTOR_LEASE @"ActiveProxyDescriptorLease"
 #define WEB_SOCKET_CONNECTION_PREFERENCES_USER_PROXIES                  @"UserProxies"
 #define WEB_SOCKET_CONNECTION_PREFERENCES_USER_PROXY_ENABLE             @"UserProxyEnable"
+#define WEB_SOCKET_CONNECTION_PREFERENCES_PROXY_SCORES                  @"ProxyScores"
 #define CONNECTIVITY_SERVICE_MAX_PROXIES 4
 #define MAX_LEASE 64
 
@@ -53,6 +54,7 @@ static void ReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReach
 @property (nullable) nw_path_monitor_t pathMonitor;
 @property (nullable) NSString *userProxyConfig;
 @property BOOL connectedNetwork;
+@property BOOL wakeupSignaled;
 @property BOOL proxyEnabled;
 @property int proxyDescriptorLease;
 @property int activeProxyIndex;
@@ -352,6 +354,22 @@ static void ReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReach
     }
 }
 
+- (nonnull NSDictionary<NSString *, NSArray<NSNumber *> *> *)loadProxyScores {
+    DDLogVerbose(@"%@: loadProxyScores", LOG_TAG);
+
+    NSUserDefaults *userDefaults = [TLTwinlife getAppSharedUserDefaults];
+    NSDictionary *scores = [userDefaults dictionaryForKey:WEB_SOCKET_CONNECTION_PREFERENCES_PROXY_SCORES];
+    return scores ? scores : @{};
+}
+
+- (void)saveProxyScores:(nonnull NSDictionary<NSString *, NSArray<NSNumber *> *> *)scores {
+    DDLogVerbose(@"%@: saveProxyScores: %@", LOG_TAG, scores);
+
+    NSUserDefaults *userDefaults = [TLTwinlife getAppSharedUserDefaults];
+    [userDefaults setObject:scores forKey:WEB_SOCKET_CONNECTION_PREFERENCES_PROXY_SCORES];
+    [userDefaults synchronize];
+}
+
 - (void)reconnect {
     DDLogVerbose(@"%@: reconnect", LOG_TAG);
 
@@ -372,8 +390,16 @@ static void ReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReach
         return YES;
     }
     
+    // The wakeup flag is latched by the condition so that a reachability change or a signalAll
+    // that happens before we start waiting is not lost.
+    NSDate *deadline = [[NSDate alloc] initWithTimeIntervalSinceNow:timeout];
     [self.connectedCondition lock];
-    [self.connectedCondition waitUntilDate:[[NSDate alloc] initWithTimeIntervalSinceNow:timeout]];
+    while (!self.wakeupSignaled && !self.connectedNetwork) {
+        if (![self.connectedCondition waitUntilDate:deadline]) {
+            break;
+        }
+    }
+    self.wakeupSignaled = NO;
     [self.connectedCondition unlock];
     
     // We were suspended for some time, the network could have changed, get its status again.
@@ -387,7 +413,8 @@ static void ReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReach
     DDLogVerbose(@"%@: signalAll", LOG_TAG);
     
     [self.connectedCondition lock];
-    [self.connectedCondition signal];
+    self.wakeupSignaled = YES;
+    [self.connectedCondition broadcast];
     [self.connectedCondition unlock];
 }
 
@@ -470,6 +497,7 @@ static void ReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReach
     DDLogVerbose(@"%@: onNetworkConnect", LOG_TAG);
     
     [self.connectedCondition lock];
+    self.wakeupSignaled = YES;
     [self.connectedCondition broadcast];
     [self.connectedCondition unlock];
     
@@ -33,6 +33,7 @@ typedef enum  {
 @class TLConversationService;
 @class TLSignatureInfoIQ;
 @class TLConversationServiceOperation;
+@class TLPushFileOperation;
 
 /**
  * Device state flag indicating the device is in foreground: we can keep the P2P connection opened.
@@ -86,9 +87,19 @@ typedef enum  {
  */
 #define DATA_WINDOW_SIZE (4 * DATA_CHUNK_SIZE)
 
+/**
+ * Several files can be sent at the same time on the same P2P connection (for example an album of photos):
+ * - the number of files being transferred concurrently is limited,
+ * - the files share a global data window which is split between them so that each file gets a fair share,
+ * - a single file keeps the DATA_WINDOW_SIZE window and each file can always send at least one chunk.
+ */
+#define MAX_CONCURRENT_FILE_TRANSFERS 4
+#define SHARED_DATA_WINDOW_SIZE (8 * DATA_CHUNK_SIZE)
+
 static const int CONVERSATION_SERVICE_MAJOR_VERSION_2 = 2;
 static const int CONVERSATION_SERVICE_MAJOR_VERSION_1 = 1;
 
+static const int CONVERSATION_SERVICE_MINOR_VERSION_21 = 21;
 static const int CONVERSATION_SERVICE_MINOR_VERSION_20 = 20;
 static const int CONVERSATION_SERVICE_MINOR_VERSION_19 = 19;
 static const int CONVERSATION_SERVICE_MINOR_VERSION_18 = 18;
@@ -113,7 +124,7 @@ static const int CONVERSATION_SERVICE_MINOR_VERSION_0 = 0;
 static const int MAX_MAJOR_VERSION = CONVERSATION_SERVICE_MAJOR_VERSION_2;
 
 // The maximum minor number that is supported by the major version 2.
-static const int MAX_MINOR_VERSION_2 = CONVERSATION_SERVICE_MINOR_VERSION_20;
+static const int MAX_MINOR_VERSION_2 = CONVERSATION_SERVICE_MINOR_VERSION_21;
 static const int MAX_MINOR_VERSION_1 = CONVERSATION_SERVICE_MINOR_VERSION_0;
 
 typedef enum {
@@ -216,6 +227,18 @@ typedef enum {
 /// Returns YES if we have some file transfer in progress.
 - (BOOL)isTransferingFile;
 
+/// Register the push file operation as actively sending data chunks on this connection.
+- (void)startFileTransferWithOperation:(nonnull TLPushFileOperation *)operation;
+
+/// Remove the push file operation from the active file transfers and release its sending file.
+- (void)finishFileTransferWithOperation:(nonnull TLPushFileOperation *)operation;
+
+/// Get the push file operations which are actively sending data chunks on this connection.
+- (nonnull NSArray<TLPushFileOperation *> *)activeFileTransfers;
+
+/// Get the data window that a file transfer is allowed to use according to the number of active file transfers.
+- (int64_t)fileTransferWindowSize;
+
 /// Get the best data chunk size for communicating with the peer.
 - (int)bestChunkSize;
 
@@ -237,6 +260,10 @@ typedef enum {
 
 - (void)updateDescriptorTimestamps:(nonnull TLDescriptor *)descriptor;
 
+/// Get the SHA256 digest of the file content if it is known.  Otherwise, the digest is computed
+/// and recorded in the background for the next transfers and nil is returned.
+- (nullable NSData *)contentDigestWithDescriptor:(nonnull TLFileDescriptor *)fileDescriptor;
+
 - (nullable TLSignatureInfoIQ *)createSignatureWithConnection:(nonnull TLConversationConnection *)connection groupTwincodeId:(nonnull NSUUID *)groupTwincodeId;
 
 @end
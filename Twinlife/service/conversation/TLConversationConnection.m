@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2025 twinlife SA.
+ *  Copyright (c) 2025-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -29,6 +29,8 @@
 #import "TLSendingFileInfo.h"
 #import "TLReceivingFileInfo.h"
 #import "TLFileInfo.h"
+#import "TLPushFileOperation.h"
+#import "NSData+Extensions.h"
 
 #if 0
 static const int ddLogLevel = DDLogLevelVerbose;
@@ -38,6 +40,16 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallclock time adjustment in ms made.
 
+//
+// Interface: TLConversationConnection ()
+//
+
+@interface TLConversationConnection ()
+
+@property (readonly, nonnull) NSMutableArray<TLPushFileOperation *> *fileTransfers;
+
+@end
+
 //
 // Implementation: TLConversationConnection
 //
@@ -57,6 +69,7 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
         _peerConnectionService = [twinlife getPeerConnectionService];
         _conversationService = [twinlife getConversationService];
         _withLeadingPadding = YES;
+        _fileTransfers = [[NSMutableArray alloc] init];
         if (incoming) {
             _incomingState = TLConversationStateCreating;
         } else {
@@ -125,6 +138,9 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
 - (TLBaseServiceErrorCode)deleteFileDescriptorWithConnection:(nonnull TLConversationConnection*)connection fileDescriptor:(nonnull TLFileDescriptor *)fileDescriptor operation:(nonnull TLConversationServiceOperation *)operation {
     
     [self.conversationService.scheduler removeOperation:operation];
+    if ([operation isKindOfClass:[TLPushFileOperation class]]) {
+        [connection finishFileTransferWithOperation:(TLPushFileOperation *)operation];
+    }
 
     // File was removed, send a delete descriptor operation.
     TLConversationImpl *conversationImpl = connection.conversation;
@@ -153,6 +169,43 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
     [self.conversationService.serviceProvider updateDescriptorTimestamps:descriptor];
 }
 
+- (nullable NSData *)contentDigestWithDescriptor:(nonnull TLFileDescriptor *)fileDescriptor {
+    DDLogVerbose(@"%@ contentDigestWithDescriptor: %@", LOG_TAG, fileDescriptor);
+
+    NSData *sha256 = [self.conversationService.serviceProvider loadContentDigestWithDescriptor:fileDescriptor];
+    if (!sha256) {
+        [self recordContentDigestWithDescriptor:fileDescriptor sha256:nil];
+    }
+    return sha256;
+}
+
+- (void)recordContentDigestWithDescriptor:(nonnull TLFileDescriptor *)fileDescriptor sha256:(nullable NSData *)sha256 {
+    DDLogVerbose(@"%@ recordContentDigestWithDescriptor: %@", LOG_TAG, fileDescriptor);
+
+    TLConversationServiceProvider *serviceProvider = self.conversationService.serviceProvider;
+    if (sha256) {
+        [serviceProvider storeContentDigest:sha256 descriptor:fileDescriptor];
+        return;
+    }
+
+    // Hashing a large file takes time: never do it on the conversation executor queue.
+    static dispatch_queue_t digestQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        digestQueue = dispatch_queue_create("twinlife.conversation.digest", DISPATCH_QUEUE_SERIAL);
+    });
+    NSString *path = [fileDescriptor getPathWithFileManager:[NSFileManager defaultManager]];
+    if (!path) {
+        return;
+    }
+    dispatch_async(digestQueue, ^{
+        NSData *digest = [NSData sha256WithPath:path];
+        if (digest) {
+            [serviceProvider storeContentDigest:digest descriptor:fileDescriptor];
+        }
+    });
+}
+
 #pragma - mark PeerConnection
 
 - (BOOL)canStartOutgoingWithTimestamp:(int64_t)now {
@@ -272,6 +325,9 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
     self.peerDeviceState = 0;
     self.peerConnectionId = nil;
     self.startConversationTime = 0;
+    @synchronized (self) {
+        [self.fileTransfers removeAllObjects];
+    }
     [self.conversation closeConnection];
     return YES;
 }
@@ -466,25 +522,28 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
         if (!receivingFile) {
             NSFileManager *fileManager = [NSFileManager defaultManager];
             NSString *path = [fileDescriptor getPathWithFileManager:fileManager];
-            receivingFile = [[TLReceivingFileInfo alloc] initWithPath:path];
+            receivingFile = [[TLReceivingFileInfo alloc] initWithPath:path length:fileDescriptor.length];
             [self.receivingFiles setObject:receivingFile forKey:fileDescriptor];
-
-            if (!chunk) {
-                [receivingFile seekToFileOffset:LONG_MAX];
-                return [receivingFile position];
-            } else {
-                [receivingFile seekToFileOffset:chunkStart];
-            }
         }
 
+        // Chunks are written where they belong and we always report the first hole:
+        // after a disconnection the peer only sends what is missing.
         if (!chunk) {
-            return [receivingFile length];
+            return [receivingFile nextMissingOffset];
         }
 
-        int64_t position = [receivingFile writeChunkWithData:chunk];
+        int64_t position = [receivingFile writeChunkWithData:chunk offset:chunkStart];
+        if (position < 0) {
+            [self cancelWithFileDescriptor:fileDescriptor];
+            return -1L;
+        }
         if (position == [fileDescriptor length]) {
             [receivingFile close];
             [self.receivingFiles removeObjectForKey:fileDescriptor];
+
+            // Record the content digest so that we can avoid receiving the same content again
+            // (it is known when the file was received in order, otherwise it is computed in the background).
+            [self recordContentDigestWithDescriptor:fileDescriptor sha256:receivingFile.sha256];
         }
 
         return position;
@@ -506,6 +565,59 @@ static const int64_t MAX_ADJUST_TIME = 3600 * 1000; // Absolute maximum wallcloc
     return NO;
 }
 
+- (void)startFileTransferWithOperation:(nonnull TLPushFileOperation *)operation {
+    DDLogVerbose(@"%@ startFileTransferWithOperation: %@", LOG_TAG, operation);
+
+    @synchronized (self) {
+        if (![self.fileTransfers containsObject:operation]) {
+            [self.fileTransfers addObject:operation];
+        }
+    }
+}
+
+- (void)finishFileTransferWithOperation:(nonnull TLPushFileOperation *)operation {
+    DDLogVerbose(@"%@ finishFileTransferWithOperation: %@", LOG_TAG, operation);
+
+    @synchronized (self) {
+        [self.fileTransfers removeObject:operation];
+    }
+
+    // Release the file handle now: with several files sent in sequence or concurrently we don't want
+    // to keep every sent file open until the P2P connection is closed.
+    TLFileDescriptor *fileDescriptor = operation.fileDescriptor;
+    if (fileDescriptor && self.sendingFiles) {
+        TLSendingFileInfo *sendingFile = [self.sendingFiles objectForKey:fileDescriptor];
+        if (sendingFile) {
+            [sendingFile cancel];
+            [self.sendingFiles removeObjectForKey:fileDescriptor];
+        }
+    }
+}
+
+- (nonnull NSArray<TLPushFileOperation *> *)activeFileTransfers {
+    DDLogVerbose(@"%@ activeFileTransfers", LOG_TAG);
+
+    @synchronized (self) {
+        return [[NSArray alloc] initWithArray:self.fileTransfers];
+    }
+}
+
+- (int64_t)fileTransferWindowSize {
+    DDLogVerbose(@"%@ fileTransferWindowSize", LOG_TAG);
+
+    NSUInteger count;
+    @synchronized (self) {
+        count = self.fileTransfers.count;
+    }
+    if (count <= 1) {
+        return DATA_WINDOW_SIZE;
+    }
+
+    // Split the shared window between the active files but allow each of them to send at least one chunk.
+    int64_t window = MIN(DATA_WINDOW_SIZE, SHARED_DATA_WINDOW_SIZE / (int64_t)count);
+    return MAX(window, (int64_t)[self bestChunkSize]);
+}
+
 - (int)bestChunkSize {
     DDLogVerbose(@"%@ bestChunkSize", LOG_TAG);
 
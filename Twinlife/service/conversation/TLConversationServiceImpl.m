@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2025 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -110,7 +110,7 @@ static const int ddLogLevel = DDLogLevelVerbose;
 static const int ddLogLevel = DDLogLevelWarning;
 #endif
 
-#define CONVERSATION_SERVICE_VERSION @"2.20.1" // MUST ALSO UPDATE MAX_MAJOR_VERSION, MAX_MINOR_VERSION_2
+#define CONVERSATION_SERVICE_VERSION @"2.21.0" // MUST ALSO UPDATE MAX_MAJOR_VERSION, MAX_MINOR_VERSION_2
 
 #define ENABLE_HARD_RESET (NO)
 
@@ -1195,6 +1195,9 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
         [self addPacketListener:[TLPushFileIQ SERIALIZER_7] listener:^(TLConversationConnection *connection, TLBinaryPacketIQ * iq) {
             [handler processPushFileIQWithConnection:connection iq:(TLPushFileIQ *)iq];
         }];
+        [self addPacketListener:[TLPushFileIQ SERIALIZER_8] listener:^(TLConversationConnection *connection, TLBinaryPacketIQ * iq) {
+            [handler processPushFileIQWithConnection:connection iq:(TLPushFileIQ *)iq];
+        }];
         [self addPacketListener:[TLOnPushFileIQ SERIALIZER_2] listener:^(TLConversationConnection *connection, TLBinaryPacketIQ * iq) {
             [handler processOnPushFileIQWithConnection:connection iq:(TLOnPushIQ *)iq];
         }];
@@ -2098,6 +2101,12 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
 
             return;
         }
+
+        // The forwarded file has the same content: keep its digest to avoid computing it again.
+        NSData *sha256 = [self.serviceProvider loadContentDigestWithDescriptor:(TLFileDescriptor *)descriptor];
+        if (sha256) {
+            [self.serviceProvider storeContentDigest:sha256 descriptor:(TLFileDescriptor *)forwarded];
+        }
     }
 
     [self.serviceProvider setAnnotationWithDescriptor:descriptor type:TLDescriptorAnnotationTypeForwarded value:0];
@@ -4418,6 +4427,32 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
     });
 }
 
+- (void)executeFileTransfersWithConnection:(nonnull TLConversationConnection *)connection {
+    DDLogVerbose(@"%@ executeFileTransfersWithConnection: %@", LOG_TAG, connection);
+
+    // Concurrent file transfers are only possible when the peer acknowledges data chunks in batch mode.
+    if (![connection isSupportedWithMajorVersion:CONVERSATION_SERVICE_MAJOR_VERSION_2 minorVersion:CONVERSATION_SERVICE_MINOR_VERSION_12]) {
+        return;
+    }
+
+    dispatch_async(self.executorQueue, ^{
+        if ([connection state] != TLConversationStateOpen) {
+            return;
+        }
+
+        // Files that are already streaming can use a bigger share of the data window.
+        for (TLPushFileOperation *operation in [connection activeFileTransfers]) {
+            [self sendOperationInternalWithConnection:connection operation:operation];
+        }
+
+        // Start the next files queued after the active ones.
+        int limit = MAX_CONCURRENT_FILE_TRANSFERS;
+        for (TLConversationServiceOperation *operation in [self.scheduler getConcurrentFileOperationsWithConversation:connection.conversation limit:limit]) {
+            [self sendOperationInternalWithConnection:connection operation:operation];
+        }
+    });
+}
+
 - (void)executeOperationInternalWithConversation:(TLConversationImpl *)conversation {
     DDLogVerbose(@"%@ executeOperationInternalWithConversation: %@", LOG_TAG, conversation);
     
@@ -5250,6 +5285,12 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
         } else {
             // fileDescriptor.path = path;
             [self popWithDescriptor:fileDescriptor connection:connection];
+
+            // We may already have the same content (ex: a file forwarded to us several times):
+            // copy it and tell the peer we have everything so that it does not send the chunks.
+            if (iq.sha256 && [self receiveLocalContentWithConnection:connection iq:iq]) {
+                return;
+            }
         }
     } else {
         // Send him back a receive failure.
@@ -5262,6 +5303,60 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
     [connection sendPacketWithStatType:TLPeerConnectionServiceStatTypeIqResultPushFile iq:onPushIQ];
 }
 
+- (BOOL)receiveLocalContentWithConnection:(nonnull TLConversationConnection *)connection iq:(nonnull TLPushFileIQ *)iq {
+    DDLogVerbose(@"%@ receiveLocalContentWithConnection: %@ pushFileIQ: %@", LOG_TAG, connection, iq);
+
+    TLDescriptor *descriptor = [self.serviceProvider loadDescriptorWithDescriptorId:iq.fileDescriptor.descriptorId];
+    if (!descriptor || ![descriptor isKindOfClass:[TLFileDescriptor class]]) {
+        return NO;
+    }
+
+    // Nothing must have been received yet for this file.
+    TLFileDescriptor *fileDescriptor = (TLFileDescriptor *)descriptor;
+    if (fileDescriptor.end > 0 || fileDescriptor.length <= 0) {
+        return NO;
+    }
+
+    // Only use a content that was already exchanged in this conversation: a peer must not be able
+    // to probe the files we hold in other conversations by sending their digest.
+    TLFileDescriptor *localDescriptor = [self.serviceProvider loadFileDescriptorWithContentDigest:iq.sha256 length:fileDescriptor.length conversationId:fileDescriptor.conversationId];
+    if (!localDescriptor) {
+        return NO;
+    }
+
+    // Replace the empty file by a copy of the local content (the copy is a clone on APFS).
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *sourcePath = [localDescriptor getPathWithFileManager:fileManager];
+    NSString *destinationPath = [fileDescriptor getPathWithFileManager:fileManager];
+    NSError *error;
+    [fileManager removeItemAtPath:destinationPath error:&error];
+    if (![fileManager copyItemAtPath:sourcePath toPath:destinationPath error:&error]) {
+        DDLogError(@"%@ cannot copy %@ to %@: %@", LOG_TAG, sourcePath, destinationPath, error);
+        return NO;
+    }
+
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    fileDescriptor.end = fileDescriptor.length;
+    fileDescriptor.updatedTimestamp = now;
+    fileDescriptor.receivedTimestamp = now;
+    [self.serviceProvider updateWithDescriptor:fileDescriptor];
+    [self.serviceProvider storeContentDigest:iq.sha256 descriptor:fileDescriptor];
+
+    int deviceState = [self getDeviceStateWithConnection:connection];
+    TLOnPushFileChunkIQ *onPushFileChunkIQ = [[TLOnPushFileChunkIQ alloc] initWithSerializer:[TLOnPushFileChunkIQ SERIALIZER_2] requestId:iq.requestId deviceState:deviceState receivedTimestamp:now senderTimestamp:0 nextChunkStart:fileDescriptor.length];
+    [connection sendPacketWithStatType:TLPeerConnectionServiceStatTypeIqResultPushFileChunk iq:onPushFileChunkIQ];
+
+    for (id delegate in self.delegates) {
+        if ([delegate respondsToSelector:@selector(onUpdateDescriptorWithRequestId:conversation:descriptor:updateType:)]) {
+            id<TLConversationServiceDelegate> lDelegate = delegate;
+            dispatch_async([self.twinlife twinlifeQueue], ^{
+                [lDelegate onUpdateDescriptorWithRequestId:[TLBaseService DEFAULT_REQUEST_ID] conversation:connection.conversation descriptor:fileDescriptor updateType:TLConversationServiceUpdateTypeContent];
+            });
+        }
+    }
+    return YES;
+}
+
 - (void)processLegacyPushFileIQWithConnection:(nonnull TLConversationConnection *)connection pushFileIQ:(TLConversationServicePushFileIQ *)pushFileIQ {
     DDLogVerbose(@"%@ processLegacyPushFileIQWithConnection: %@ pushFileIQ: %@", LOG_TAG, connection, pushFileIQ);
     
@@ -6169,6 +6264,9 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
                     pushFileOperation.chunkStart = 0;
                     [self.serviceProvider updateFileOperation:pushFileOperation];
                     [pushFileOperation executeWithConnection:connection];
+
+                    // While this file is streaming, start the next queued files on the same connection.
+                    [self executeFileTransfersWithConnection:connection];
                     return;
                 }
             }
@@ -6217,6 +6315,12 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
                 if (iq.nextChunkStart < fileDescriptor.length) {
                     [connection updateEstimatedRttWithTimestamp:iq.senderTimestamp];
 
+                    // Everything was sent but the peer still reports the same hole: a chunk was lost,
+                    // send again from that hole (the peer overwrites the chunks it already has).
+                    if (pushFileOperation.sentOffset >= fileDescriptor.length && pushFileOperation.chunkStart == iq.nextChunkStart) {
+                        pushFileOperation.sentOffset = iq.nextChunkStart;
+                    }
+
                     // We keep the same request id on the operation and continue sending more chunks.
                     pushFileOperation.chunkStart = iq.nextChunkStart;
                     [pushFileOperation executeWithConnection:connection];
@@ -6241,6 +6345,11 @@ TL_CREATE_ASSERT_POINT(LOCK_CONVERSATION_FAILED, 106)
     }
     
     [self.scheduler finishOperation:operation connection:connection];
+
+    // The data window released by this file is now shared by the other files being transferred.
+    if ([operation isKindOfClass:[TLPushFileOperation class]]) {
+        [self executeFileTransfersWithConnection:connection];
+    }
 }
 
 - (void)processLegacyOnPushFileChunkIQWithConnection:(nonnull TLConversationConnection *)connection onPushFileChunkIQ:(TLConversationServiceOnPushFileChunkIQ *)onPushFileChunkIQ {
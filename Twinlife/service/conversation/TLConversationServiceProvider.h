@@ -189,4 +189,13 @@ typedef enum {
 
 - (void)deleteOperationWithOperationId:(int64_t)operationId;
 
+/// Get the SHA256 digest of the file content associated with the file descriptor if it is known.
+- (nullable NSData *)loadContentDigestWithDescriptor:(nonnull TLFileDescriptor *)descriptor;
+
+/// Record the SHA256 digest of the file content associated with the file descriptor.
+- (void)storeContentDigest:(nonnull NSData *)sha256 descriptor:(nonnull TLFileDescriptor *)descriptor;
+
+/// Find a file descriptor of the conversation whose file content has the given SHA256 digest and length and is fully available locally.
+- (nullable TLFileDescriptor *)loadFileDescriptorWithContentDigest:(nonnull NSData *)sha256 length:(int64_t)length conversationId:(int64_t)conversationId;
+
 @end
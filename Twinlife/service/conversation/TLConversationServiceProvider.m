@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2025 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -175,6 +175,22 @@ static const int ddLogLevel = DDLogLevelWarning;
                 " descriptor INTEGER, chunkStart INTEGER, content BLOB" \
                 ")"
 
+/**
+ * content table:
+ * descriptor INTEGER: the file descriptor key (primary key)
+ * length INTEGER NOT NULL: the file length
+ * sha256 BLOB NOT NULL: the SHA256 of the file content
+ *
+ * Used to avoid transferring the same file content several times (ex: a forwarded video).
+ */
+#define CONTENT_TABLE \
+        @"CREATE TABLE IF NOT EXISTS content (descriptor INTEGER PRIMARY KEY," \
+                " length INTEGER NOT NULL, sha256 BLOB NOT NULL" \
+                ")"
+
+#define CONTENT_INDEX \
+        @"CREATE INDEX IF NOT EXISTS idx_content_sha256 ON content (sha256, length)"
+
 #define SERIALIZER_BUFFER_DEFAULT_SIZE 1024
 
 //
@@ -263,6 +279,8 @@ static const int ddLogLevel = DDLogLevelWarning;
     [transaction createSchemaWithSQL:INVITATION_TABLE];
     [transaction createSchemaWithSQL:ANNOTATION_TABLE];
     [transaction createSchemaWithSQL:OPERATION_TABLE];
+    [transaction createSchemaWithSQL:CONTENT_TABLE];
+    [transaction createSchemaWithSQL:CONTENT_INDEX];
 }
 
 - (void)onUpgradeWithTransaction:(nonnull TLTransaction *)transaction oldVersion:(int)oldVersion newVersion:(int)newVersion {
@@ -270,6 +288,10 @@ static const int ddLogLevel = DDLogLevelWarning;
     
     /**
      * <pre>
+     * Database Version 26
+     *  Date: 2026/10/18
+     *    Add the content table to find files by their content digest.
+     *
      * Database Version 21
      *  Date: 2024/05/07
      *    Add columns creationDate and notificationId in the annotation table to record who annotates for the notification.
@@ -2472,6 +2494,90 @@ static const int ddLogLevel = DDLogLevelWarning;
     }];
 }
 
+- (nullable NSData *)loadContentDigestWithDescriptor:(nonnull TLFileDescriptor *)descriptor {
+    DDLogVerbose(@"%@ loadContentDigestWithDescriptor: %@", LOG_TAG, descriptor.descriptorId);
+
+    __block NSData *sha256 = nil;
+    [self inDatabase:^(FMDatabase *database) {
+        if (!database) {
+            return;
+        }
+
+        FMResultSet *resultSet = [database executeQuery:@"SELECT sha256 FROM content WHERE descriptor=? AND length=?", [NSNumber numberWithLong:descriptor.descriptorId.id], [NSNumber numberWithLongLong:descriptor.length]];
+        if (!resultSet) {
+            [self.service onDatabaseErrorWithError:[database lastError] line:__LINE__];
+            return;
+        }
+        if ([resultSet next]) {
+            sha256 = [resultSet dataForColumnIndex:0];
+        }
+        [resultSet close];
+    }];
+    return sha256;
+}
+
+- (void)storeContentDigest:(nonnull NSData *)sha256 descriptor:(nonnull TLFileDescriptor *)descriptor {
+    DDLogVerbose(@"%@ storeContentDigest: %@", LOG_TAG, descriptor.descriptorId);
+
+    [self inTransaction:^(TLTransaction *transaction) {
+        [transaction executeUpdate:@"INSERT OR REPLACE INTO content (descriptor, length, sha256) VALUES(?, ?, ?)", [NSNumber numberWithLong:descriptor.descriptorId.id], [NSNumber numberWithLongLong:descriptor.length], sha256];
+        [transaction commit];
+    }];
+}
+
+- (nullable TLFileDescriptor *)loadFileDescriptorWithContentDigest:(nonnull NSData *)sha256 length:(int64_t)length conversationId:(int64_t)conversationId {
+    DDLogVerbose(@"%@ loadFileDescriptorWithContentDigest: %lld conversationId: %lld", LOG_TAG, length, conversationId);
+
+    NSMutableArray<NSNumber *> *descriptorIds = [[NSMutableArray alloc] init];
+    [self inDatabase:^(FMDatabase *database) {
+        if (!database) {
+            return;
+        }
+
+        FMResultSet *resultSet = [database executeQuery:@"SELECT c.descriptor FROM content AS c INNER JOIN descriptor AS d ON c.descriptor=d.id"
+                                  " WHERE c.sha256=? AND c.length=? AND d.cid=? ORDER BY c.descriptor DESC", sha256, [NSNumber numberWithLongLong:length], [NSNumber numberWithLongLong:conversationId]];
+        if (!resultSet) {
+            [self.service onDatabaseErrorWithError:[database lastError] line:__LINE__];
+            return;
+        }
+        while ([resultSet next]) {
+            [descriptorIds addObject:[NSNumber numberWithLongLong:[resultSet longLongIntForColumnIndex:0]]];
+        }
+        [resultSet close];
+    }];
+
+    // The descriptor or its file could have been removed: check that we still have the complete file.
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSMutableArray<NSNumber *> *staleIds = nil;
+    TLFileDescriptor *result = nil;
+    for (NSNumber *descriptorId in descriptorIds) {
+        TLDescriptor *descriptor = [self loadDescriptorWithId:descriptorId.longLongValue];
+        if (descriptor && [descriptor isKindOfClass:[TLFileDescriptor class]] && descriptor.deletedTimestamp <= 0) {
+            TLFileDescriptor *fileDescriptor = (TLFileDescriptor *)descriptor;
+            NSString *path = [fileDescriptor getPathWithFileManager:fileManager];
+            NSDictionary<NSFileAttributeKey, id> *attributes = path ? [fileManager attributesOfItemAtPath:path error:nil] : nil;
+            if ([fileDescriptor isAvailable] && fileDescriptor.length == length && attributes && [attributes fileSize] == length) {
+                result = fileDescriptor;
+                break;
+            }
+        }
+        if (!staleIds) {
+            staleIds = [[NSMutableArray alloc] init];
+        }
+        [staleIds addObject:descriptorId];
+    }
+
+    if (staleIds) {
+        [self inTransaction:^(TLTransaction *transaction) {
+            for (NSNumber *descriptorId in staleIds) {
+                [transaction executeUpdate:@"DELETE FROM content WHERE descriptor=?", descriptorId];
+            }
+            [transaction commit];
+        }];
+    }
+    return result;
+}
+
 + (int)fromDescriptorType:(TLDescriptorType)type {
     
     switch (type) {
@@ -127,6 +127,11 @@
 /// Get the first active pending operation for the conversation.
 - (nullable TLConversationServiceOperation *)getFirstActiveOperationWithConversation:(nonnull TLConversationImpl *)conversation;
 
+/// Get the push file operations that are queued after the active push file operations and that can be started
+/// concurrently on the same connection.  Only the leading push file operations of the queue are considered so that
+/// other operations are never executed before them.
+- (nonnull NSArray<TLConversationServiceOperation *> *)getConcurrentFileOperationsWithConversation:(nonnull TLConversationImpl *)conversation limit:(int)limit;
+
 /// Get the operation with the given request ID.
 - (nullable TLConversationServiceOperation *)getOperationWithConversation:(nonnull TLConversationImpl *)conversation requestId:(int64_t)requestId;
 
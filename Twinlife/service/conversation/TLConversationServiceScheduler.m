@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2019-2025 twinlife SA.
+ *  Copyright (c) 2019-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -490,6 +490,7 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
         [self.activeConnections removeAllObjects];
         [self.conversationId2Operations removeAllObjects];
     }
+    [self.jobService finishWithJob:self];
 }
 
 #pragma mark - JobService
@@ -671,6 +672,14 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
     [self scheduleOperations];
 }
 
+- (BOOL)isJobRunning {
+
+    // The job is running until the connections used by the active operations are closed.
+    @synchronized(self) {
+        return self.activeOperations.count > 0;
+    }
+}
+
 - (nullable TLConversationServiceOperation *)getOperationWithConversation:(nonnull TLConversationImpl *)conversation requestId:(int64_t)requestId {
     DDLogVerbose(@"%@ getOperationWithConversation: %@ requestId: %lld", LOG_TAG, conversation.identifier, requestId);
     
@@ -732,6 +741,36 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
     return operation;
 }
 
+- (nonnull NSArray<TLConversationServiceOperation *> *)getConcurrentFileOperationsWithConversation:(nonnull TLConversationImpl *)conversation limit:(int)limit {
+    DDLogVerbose(@"%@ getConcurrentFileOperationsWithConversation: %@ limit: %d", LOG_TAG, conversation.identifier, limit);
+
+    NSMutableArray<TLConversationServiceOperation *> *result = [[NSMutableArray alloc] init];
+    @synchronized(self) {
+        TLConversationOperationQueue *operations = self.conversationId2Operations[conversation.identifier];
+        if (!operations || operations.count == 0) {
+            return result;
+        }
+
+        int active = 0;
+        for (TLConversationServiceOperation *operation in operations.queue) {
+            if (![operation isKindOfClass:[TLPushFileOperation class]]) {
+                break;
+            }
+            if (operation.requestId != TLConversationServiceOperation.NO_REQUEST_ID) {
+                active++;
+            } else if (active + (int)result.count < limit) {
+                [result addObject:operation];
+            } else {
+                break;
+            }
+        }
+    }
+
+    DDLogVerbose(@"%@ getConcurrentFileOperationsWithConversation: %@ count=%lu", LOG_TAG, conversation.identifier, (unsigned long)result.count);
+
+    return result;
+}
+
 - (nullable TLNotificationContent *)prepareNotificationWithConversation:(nonnull TLConversationImpl *)conversation {
     DDLogVerbose(@"%@ prepareNotificationWithConversation: %@", LOG_TAG, conversation.identifier);
     
@@ -899,6 +938,7 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
     
     BOOL synchronizePeerNotification = NO;
     BOOL needReschedule = NO;
+    BOOL finished;
     TLConversationOperationQueue *operations;
     TLConversationImpl *conversation = connection.conversation;
     @synchronized(self) {
@@ -931,9 +971,14 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
             self.isReschedulePending = YES;
             needReschedule = YES;
         }
+        finished = self.activeOperations.count == 0;
     }
     DDLogInfo(@"%@ closeWithConversation: %@ pending operations: %d", LOG_TAG, conversation.identifier, operations ? (int)operations.count : 0);
 
+    if (finished) {
+        [self.jobService finishWithJob:self];
+    }
+
     if (needReschedule) {
         DDLogInfo(@"%@ closeWithConversation: %@ start scheduler in 1s", LOG_TAG, conversation.identifier);
 
@@ -1130,6 +1175,9 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
     
     if (operation) {
         [self.serviceProvider deleteOperationWithOperationId:operation.id];
+        if ([operation isKindOfClass:[TLPushFileOperation class]]) {
+            [connection finishFileTransferWithOperation:(TLPushFileOperation *)operation];
+        }
     }
     
     TLConversationImpl *conversation = connection.conversation;
@@ -1164,6 +1212,10 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
     if (canExecute) {
         [self.conversationService executeNextOperationWithConnection:connection operation:nextOperation];
 
+    } else if (nextOperation && nextOperation.requestId != TLConversationServiceOperation.NO_REQUEST_ID) {
+        // The next operation is still running (ex: a concurrent file transfer): wait for its completion.
+        return;
+
     } else {
         int deviceState = connection.peerDeviceState;
 
@@ -1270,6 +1322,7 @@ static const int64_t EXPIRATION_DELAY = 14 * 24 * 3600 * 1000; // ms (14 days)
             self.scheduleJobId = nil;
         }
     }
+    [self.jobService finishWithJob:self];
 }
 
 @end
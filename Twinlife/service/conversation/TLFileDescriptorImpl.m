@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2016-2025 twinlife SA.
+ *  Copyright (c) 2016-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -16,6 +16,7 @@
 #import "TLEncoder.h"
 #import "TLSerializerFactory.h"
 #import "TLTwinlifeImpl.h"
+#import "TLReceivingFileInfo.h"
 
 /**
  * <pre>
@@ -511,6 +512,11 @@ static const BOOL FILE_DESCRIPTOR_DEFAULT_COPY_ALLOWED = false;
     NSString *path = [self getPathWithFileManager:fileManager];
     [fileManager removeItemAtPath:path error:nil];
 
+    // Remove the received ranges of a file which was not completely received.
+    if (![self isAvailable]) {
+        [fileManager removeItemAtPath:[path stringByAppendingString:RECEIVING_RANGES_EXTENSION] error:nil];
+    }
+
     if (self.hasThumbnail) {
         path = [self thumbnailPath];
         if (path) {
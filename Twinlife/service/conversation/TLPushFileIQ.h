@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2021 twinlife SA.
+ *  Copyright (c) 2021-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -29,13 +29,20 @@
 
 @property (readonly, nonnull) TLFileDescriptor *fileDescriptor;
 @property (readonly, nullable) NSData *thumbnail;
+@property (readonly, nullable) NSData *sha256;
 
 + (nonnull NSUUID *)SCHEMA_ID;
 
++ (int)SCHEMA_VERSION_8;
+
++ (nonnull TLBinaryPacketIQSerializer *) SERIALIZER_8;
+
 + (int)SCHEMA_VERSION_7;
 
 + (nonnull TLBinaryPacketIQSerializer *) SERIALIZER_7;
 
 - (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId fileDescriptor:(nonnull TLFileDescriptor *)fileDescriptor thumbnail:(nullable NSData *)thumbnail;
 
+- (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId fileDescriptor:(nonnull TLFileDescriptor *)fileDescriptor thumbnail:(nullable NSData *)thumbnail sha256:(nullable NSData *)sha256;
+
 @end
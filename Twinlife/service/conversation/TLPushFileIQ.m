@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2021-2024 twinlife SA.
+ *  Copyright (c) 2021-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -20,6 +20,18 @@
 /**
  * PushFile IQ.
  * <p>
+ * Schema version 8
+ *  Date: 2026/10/18
+ *
+ * <pre>
+ * Same as schema version 7 with the optional SHA256 of the file content appended:
+ *
+ *     {"name":"sha256", [null, "type":"bytes"]}
+ *
+ * The receiver can answer with an OnPushFileChunkIQ whose nextChunkStart is the file length when it
+ * already holds the same content: the file data is then not transferred.
+ * </pre>
+ *
  * Schema version 7
  *  Date: 2021/04/07
  *
@@ -142,6 +154,9 @@
         default:
             @throw [NSException exceptionWithName:@"TLEncoderException" reason:nil userInfo:nil];
     }
+    if (self.schemaVersion >= [TLPushFileIQ SCHEMA_VERSION_8]) {
+        [encoder writeOptionalData:pushFileIQ.sha256];
+    }
 }
 
 - (NSObject *)deserializeWithSerializerFactory:(TLSerializerFactory *)serializerFactory decoder:(id<TLDecoder>)decoder {
@@ -210,8 +225,12 @@
         default:
             @throw [NSException exceptionWithName:@"TLDecoderException" reason:nil userInfo:nil];
     }
+    NSData *sha256 = nil;
+    if (self.schemaVersion >= [TLPushFileIQ SCHEMA_VERSION_8]) {
+        sha256 = [decoder readOptionalData];
+    }
 
-    return [[TLPushFileIQ alloc] initWithSerializer:self requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnail];
+    return [[TLPushFileIQ alloc] initWithSerializer:self requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnail sha256:sha256];
 }
 
 @end
@@ -222,11 +241,14 @@
 
 @implementation TLPushFileIQ
 
+static TLPushFileIQSerializer *IQ_PUSH_FILE_SERIALIZER_8;
+static const int IQ_PUSH_FILE_SCHEMA_VERSION_8 = 8;
 static TLPushFileIQSerializer *IQ_PUSH_FILE_SERIALIZER_7;
 static const int IQ_PUSH_FILE_SCHEMA_VERSION_7 = 7;
 
 + (void)initialize {
     
+    IQ_PUSH_FILE_SERIALIZER_8 = [[TLPushFileIQSerializer alloc] initWithSchema:@"8359efba-fb7e-4378-a054-c4a9e2d37f8f" schemaVersion:IQ_PUSH_FILE_SCHEMA_VERSION_8];
     IQ_PUSH_FILE_SERIALIZER_7 = [[TLPushFileIQSerializer alloc] initWithSchema:@"8359efba-fb7e-4378-a054-c4a9e2d37f8f" schemaVersion:IQ_PUSH_FILE_SCHEMA_VERSION_7];
 }
 
@@ -235,6 +257,16 @@ static const int IQ_PUSH_FILE_SCHEMA_VERSION_7 = 7;
     return IQ_PUSH_FILE_SERIALIZER_7.schemaId;
 }
 
++ (int)SCHEMA_VERSION_8 {
+
+    return IQ_PUSH_FILE_SERIALIZER_8.schemaVersion;
+}
+
++ (nonnull TLBinaryPacketIQSerializer *) SERIALIZER_8 {
+    
+    return IQ_PUSH_FILE_SERIALIZER_8;
+}
+
 + (int)SCHEMA_VERSION_7 {
 
     return IQ_PUSH_FILE_SERIALIZER_7.schemaVersion;
@@ -247,11 +279,17 @@ static const int IQ_PUSH_FILE_SCHEMA_VERSION_7 = 7;
 
 - (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId fileDescriptor:(nonnull TLFileDescriptor *)fileDescriptor thumbnail:(nullable NSData *)thumbnail {
 
+    return [self initWithSerializer:serializer requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnail sha256:nil];
+}
+
+- (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId fileDescriptor:(nonnull TLFileDescriptor *)fileDescriptor thumbnail:(nullable NSData *)thumbnail sha256:(nullable NSData *)sha256 {
+
     self = [super initWithSerializer:serializer requestId:requestId];
     
     if (self) {
         _fileDescriptor = fileDescriptor;
         _thumbnail = thumbnail;
+        _sha256 = sha256;
     }
     return self;
 }
@@ -36,7 +36,7 @@ static int PUSH_FILE_OPERATION_NOT_INITIALIZED = -1;
 
 - (nonnull instancetype)initWithId:(int64_t)id conversationId:(nonnull TLDatabaseIdentifier *)conversationId creationDate:(int64_t)creationDate descriptorId:(int64_t)descriptorId chunkStart:(int64_t)chunkStart;
 
-/// Check if we can send more data chunk.
-- (BOOL)isReadyToSend:(int64_t)length;
+/// Check if we can send more data chunk without exceeding the data window allowed for this file.
+- (BOOL)isReadyToSend:(int64_t)length window:(int64_t)window;
 
 @end
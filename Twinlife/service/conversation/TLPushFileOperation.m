@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2016-2025 twinlife SA.
+ *  Copyright (c) 2016-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -89,7 +89,7 @@ static const int64_t CHUNK_SIZE = 256 * 1024;
     }
 }
 
-- (BOOL)isReadyToSend:(int64_t)length {
+- (BOOL)isReadyToSend:(int64_t)length window:(int64_t)window {
     
     // Check if we have sent all our data chunks.
     if (self.sentOffset >= length) {
@@ -103,9 +103,10 @@ static const int64_t CHUNK_SIZE = 256 * 1024;
         return NO;
     }
 
-    // Compute the chunk size that is not yet acknowledged and don't send if we exceed the data window (1Mb).
+    // Compute the chunk size that is not yet acknowledged and don't send if we exceed the data window
+    // (it is shared with the other files being sent on the same connection).
     int64_t sentNotAckwnoledged = self.sentOffset - self.chunkStart;
-    return sentNotAckwnoledged >= 0 && sentNotAckwnoledged < DATA_WINDOW_SIZE;
+    return sentNotAckwnoledged >= 0 && sentNotAckwnoledged < window;
 }
 
 - (TLBaseServiceErrorCode)executeWithConnection:(nonnull TLConversationConnection *)connection {
@@ -162,7 +163,18 @@ static const int64_t CHUNK_SIZE = 256 * 1024;
             }
             thumbnailData = [[NSData alloc] initWithBytes:nil length:0];
         }
-        TLPushFileIQ *pushFileIQ = [[TLPushFileIQ alloc] initWithSerializer:[TLPushFileIQ SERIALIZER_7] requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnailData];
+        // Give the content digest to a peer that can find the same content locally (ex: forwarded file)
+        // so that it can skip the transfer.
+        TLPushFileIQ *pushFileIQ;
+        NSData *sha256 = nil;
+        if ([connection isSupportedWithMajorVersion:CONVERSATION_SERVICE_MAJOR_VERSION_2 minorVersion:CONVERSATION_SERVICE_MINOR_VERSION_21]) {
+            sha256 = [connection contentDigestWithDescriptor:fileDescriptor];
+        }
+        if (sha256) {
+            pushFileIQ = [[TLPushFileIQ alloc] initWithSerializer:[TLPushFileIQ SERIALIZER_8] requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnailData sha256:sha256];
+        } else {
+            pushFileIQ = [[TLPushFileIQ alloc] initWithSerializer:[TLPushFileIQ SERIALIZER_7] requestId:requestId fileDescriptor:fileDescriptor thumbnail:thumbnailData];
+        }
 
         [connection sendPacketWithStatType:TLPeerConnectionServiceStatTypeIqSetPushFile iq:pushFileIQ];
         return TLBaseServiceErrorCodeQueued;
@@ -225,8 +237,11 @@ static const int64_t CHUNK_SIZE = 256 * 1024;
             return TLBaseServiceErrorCodeQueued;
 
         } else {
+            [connection startFileTransferWithOperation:self];
+
             int chunkSize = [connection bestChunkSize];
-            while ([self isReadyToSend:fileDescriptor.length]) {
+            int64_t window = [connection fileTransferWindowSize];
+            while ([self isReadyToSend:fileDescriptor.length window:window]) {
                 int64_t offset = self.sentOffset;
 
                 NSData *chunk = [connection readChunkWithFileDescriptor:fileDescriptor chunkStart:offset chunkSize:chunkSize];
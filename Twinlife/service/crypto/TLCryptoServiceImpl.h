@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2024-2025 twinlife SA.
+ *  Copyright (c) 2024-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -36,6 +36,9 @@
 
 - (nonnull instancetype)initWithTwincode:(nonnull TLTwincodeOutbound *)twincode modificationDate:(int64_t)modificationDate flags:(int)flags signingKey:(nullable NSData *)signingKey encryptionKey:(nullable NSData *)encryptionKey nonceSequence:(int64_t)nonceSequence keyIndex:(int)keyIndex secret:(nullable NSData *)secret;
 
+/// Make a copy of the key information with another nonce sequence (the keys are not imported again).
+- (nonnull instancetype)initWithKeyInfo:(nonnull TLKeyInfo *)keyInfo nonceSequence:(int64_t)nonceSequence;
+
 + (TLCryptoKind)toCryptoKindWithFlags:(int)flags encrypt:(BOOL)encrypt;
 
 - (nullable NSString *)publicBase64EncryptionKey;
@@ -168,4 +171,12 @@
 
 - (nullable TLSdp *)encryptWithSessionKeyPair:(nonnull id<TLSessionKeyPair>)sessionKeyPair sdp:(nonnull TLSdp *)sdp errorCode:(nonnull TLBaseServiceErrorCode *)errorCode;
 
+#if defined(DEBUG) && DEBUG == 1
+/// Internal development method to measure the cost of the crypto operations for ECDSA and Ed25519/X25519 keys:
+/// signature, verification, twincode encryption/decryption (key agreement + AES-GCM) and session encryption.
+/// Keys are generated locally and the database is not used.  The report gives the p50/p90/p99 latencies and
+/// the operations per second, it is logged and returned.  It must not be compiled for the release.
+- (nonnull NSString *)developmentBenchmarkWithCount:(int)count;
+#endif
+
 @end
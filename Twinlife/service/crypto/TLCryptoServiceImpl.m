@@ -1,11 +1,12 @@
 /*
- *  Copyright (c) 2024-2025 twinlife SA.
+ *  Copyright (c) 2024-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
  *   Stephane Carrez (Stephane.Carrez@twin.life)
  */
 
+#import <CommonCrypto/CommonDigest.h>
 #import <CocoaLumberjack.h>
 
 #import "NSData+Extensions.h"
@@ -37,6 +38,8 @@ static const int ddLogLevel = DDLogLevelWarning;
 #define SERIALIZER_BUFFER_DEFAULT_SIZE 1024
 #define MAX_ATTRIBUTES                 64
 #define ECDSA_PUBKEY_LENGTH            124
+#define VERIFY_CACHE_SIZE              256
+#define BENCHMARK_DATA_SIZE            512
 
 static NSArray<NSString *> *PREDEFINED_LIST;
 
@@ -70,6 +73,22 @@ static NSArray<NSString *> *PREDEFINED_LIST;
     return self;
 }
 
+- (nonnull instancetype)initWithKeyInfo:(nonnull TLKeyInfo *)keyInfo nonceSequence:(int64_t)nonceSequence {
+
+    self = [super init];
+    if (self) {
+        _twincodeOutbound = keyInfo.twincodeOutbound;
+        _signKind = keyInfo.signKind;
+        _encryptionKind = keyInfo.encryptionKind;
+        _keyIndex = keyInfo.keyIndex;
+        _secretKey = keyInfo.secretKey;
+        _nonceSequence = nonceSequence;
+        _signingKey = keyInfo.signingKey;
+        _encryptionKey = keyInfo.encryptionKey;
+    }
+    return self;
+}
+
 + (TLCryptoKind)toCryptoKindWithFlags:(int)flags encrypt:(BOOL)encrypt {
     
     switch (flags & TL_KEY_TYPE_MASK) {
@@ -322,6 +341,10 @@ static NSArray<NSString *> *PREDEFINED_LIST;
 @property (readonly, nonnull) TLSerializerFactory *serializerFactory;
 @property (readonly, nonnull) TLCryptoServiceProvider *serviceProvider;
 
+/// Successful signature verifications indexed by the SHA256 of the public key, signed payload and signature.
+/// The NSCache is thread safe.
+@property (readonly, nonnull) NSCache<NSData *, TLVerifyResult *> *verifyCache;
+
 @end
 
 //
@@ -373,6 +396,8 @@ static NSArray<NSString *> *PREDEFINED_LIST;
     
     _serviceProvider = [[TLCryptoServiceProvider alloc] initWithService:self database:twinlife.databaseService];
     _serializerFactory = twinlife.serializerFactory;
+    _verifyCache = [[NSCache alloc] init];
+    _verifyCache.countLimit = VERIFY_CACHE_SIZE;
 
     return self;
 }
@@ -614,17 +639,44 @@ static NSArray<NSString *> *PREDEFINED_LIST;
             // We still have some attributes to be signed: it is invalid they should have been removed.
             return [TLVerifyResult errorWithErrorCode:TLBaseServiceErrorCodeBadSignatureNotSignedAttribute];
         }
+
+        // Step 3: the same twincode is often verified several times (group members), avoid the public key operation
+        // when the same payload was already verified with the same key and signature.
+        NSData *cacheKey = [TLCryptoService verifyCacheKeyWithPublicKey:pubKey data:data signature:keySignature];
+        TLVerifyResult *verifyResult = [self.verifyCache objectForKey:cacheKey];
+        if (verifyResult) {
+            return verifyResult;
+        }
         int result = [key verifyWithData:data signature:keySignature isBase64:NO];
         if (result != 1) {
             return [TLVerifyResult errorWithErrorCode:TLBaseServiceErrorCodeBadSignature];
         }
-        return [TLVerifyResult initWithSigningKey:pubKey encryptionKey:encryptionPubKey imageSha:sha];
+        verifyResult = [TLVerifyResult initWithSigningKey:pubKey encryptionKey:encryptionPubKey imageSha:sha];
+        [self.verifyCache setObject:verifyResult forKey:cacheKey];
+        return verifyResult;
 
     } @catch (NSException *exception) {
         return [TLVerifyResult errorWithErrorCode:TLBaseServiceErrorCodeBadSignature];
     }
 }
 
++ (nonnull NSData *)verifyCacheKeyWithPublicKey:(nonnull NSData *)pubKey data:(nonnull NSData *)data signature:(nonnull NSData *)signature {
+
+    // Each field is prefixed by its length so that bytes cannot be moved from one field to the next one
+    // (ex: between the data and the signature) and produce the key of a payload that was verified.
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    for (NSData *field in @[pubKey, data, signature]) {
+        uint64_t length = CFSwapInt64HostToBig((uint64_t)field.length);
+        CC_SHA256_Update(&ctx, &length, (CC_LONG)sizeof(length));
+        CC_SHA256_Update(&ctx, field.bytes, (CC_LONG)field.length);
+    }
+
+    NSMutableData *result = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(result.mutableBytes, &ctx);
+    return result;
+}
+
 - (nonnull TLSignResult *)signAuthenticateWithTwincode:(nonnull TLTwincodeOutbound *)twincodeOutbound {
     DDLogVerbose(@"%@: signAuthenticateWithTwincode: %@", LOG_TAG, twincodeOutbound);
     
@@ -1044,4 +1096,123 @@ static NSArray<NSString *> *PREDEFINED_LIST;
     return [[TLSignatureInfoIQ alloc] initWithSerializer:TLSignatureInfoIQ.SERIALIZER requestId:[TLTwinlife newRequestId] twincodeOutboundId:twincodeOutbound.uuid publicKey:publicKey keyIndex:keyInfo.keyIndex secret:secretKey];
 }
 
+#if defined(DEBUG) && DEBUG == 1
+#pragma mark - Development benchmark
+
+typedef int (^TLBenchmarkOperation)(int i);
+
++ (void)benchmarkWithReport:(nonnull NSMutableString *)report title:(nonnull NSString *)title count:(int)count operation:(nonnull TLBenchmarkOperation)operation {
+
+    int64_t *times = malloc(sizeof(int64_t) * count);
+    if (!times) {
+        return;
+    }
+
+    int failures = 0;
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        int64_t start = [TLTwinlife timestamp];
+        if (operation(i) <= 0) {
+            failures++;
+        }
+        times[i] = [TLTwinlife timestamp] - start;
+        total += times[i];
+    }
+
+    qsort_b(times, count, sizeof(int64_t), ^int(const void *a, const void *b) {
+        int64_t t1 = *(const int64_t *)a;
+        int64_t t2 = *(const int64_t *)b;
+        return t1 < t2 ? -1 : (t1 > t2 ? 1 : 0);
+    });
+    double opsPerSecond = total > 0 ? (double)count * 1000000000.0 / (double)total : 0.0;
+    [report appendFormat:@"%-24@ p50 %8.1fus p90 %8.1fus p99 %8.1fus %10.1f op/s%@\n", title,
+     (double)times[count / 2] / 1000.0, (double)times[(count * 9) / 10] / 1000.0, (double)times[(count * 99) / 100] / 1000.0,
+     opsPerSecond, failures > 0 ? [NSString stringWithFormat:@" (%d failures)", failures] : @""];
+    free(times);
+}
+
++ (void)benchmarkWithReport:(nonnull NSMutableString *)report name:(nonnull NSString *)name signKind:(TLCryptoKind)signKind encryptKind:(TLCryptoKind)encryptKind count:(int)count {
+
+    NSData *data = [NSData secureRandomWithLength:BENCHMARK_DATA_SIZE];
+    NSData *auth = [NSData secureRandomWithLength:32];
+    NSData *salt = [NSData secureRandomWithLength:32];
+
+    // Signature of the twincode attributes.
+    TLCryptoKey *signKey = [TLCryptoKey createWithKind:signKind];
+    TLCryptoKey *verifyKey = [TLCryptoKey importPublicKey:signKind pubKey:[signKey publicKey:NO] isBase64:NO];
+    NSData *signature = [signKey signWithData:data isBase64:NO];
+    if (!verifyKey || !signature) {
+        [report appendFormat:@"%@: cannot create signing keys\n", name];
+        return;
+    }
+    [TLCryptoService benchmarkWithReport:report title:[NSString stringWithFormat:@"%@ sign", name] count:count operation:^int(int i) {
+        return [signKey signWithData:data isBase64:NO] ? 1 : 0;
+    }];
+    [TLCryptoService benchmarkWithReport:report title:[NSString stringWithFormat:@"%@ verify", name] count:count operation:^int(int i) {
+        return [verifyKey verifyWithData:data signature:signature isBase64:NO];
+    }];
+
+    // Twincode encryption: key agreement between the two twincode keys followed by AES-GCM.
+    TLCryptoKey *senderKey = [TLCryptoKey createWithKind:encryptKind];
+    TLCryptoKey *receiverKey = [TLCryptoKey createWithKind:encryptKind];
+    TLCryptoKey *receiverPubKey = [TLCryptoKey importPublicKey:encryptKind pubKey:[receiverKey publicKey:NO] isBase64:NO];
+    TLCryptoKey *senderPubKey = [TLCryptoKey importPublicKey:encryptKind pubKey:[senderKey publicKey:NO] isBase64:NO];
+    if (!receiverPubKey || !senderPubKey) {
+        [report appendFormat:@"%@: cannot create encryption keys\n", name];
+        return;
+    }
+    NSMutableData *encrypted = [[NSMutableData alloc] initWithLength:auth.length + data.length + 64];
+    TLCryptoBox *cipherBox = [TLCryptoBox createWithKind:TLCryptoBoxKindAES_GCM];
+    [cipherBox bindWithKey:senderKey peerPublicKey:receiverPubKey encrypt:YES salt:salt];
+    int encryptedLength = [cipherBox encryptAEAD:1 data:data auth:auth output:encrypted];
+    encrypted.length = encryptedLength > 0 ? encryptedLength : 0;
+
+    [TLCryptoService benchmarkWithReport:report title:[NSString stringWithFormat:@"%@ encrypt", name] count:count operation:^int(int i) {
+        TLCryptoBox *box = [TLCryptoBox createWithKind:TLCryptoBoxKindAES_GCM];
+        if ([box bindWithKey:senderKey peerPublicKey:receiverPubKey encrypt:YES salt:salt] != 1) {
+            return 0;
+        }
+        NSMutableData *output = [[NSMutableData alloc] initWithLength:auth.length + data.length + 64];
+        return [box encryptAEAD:i + 1 data:data auth:auth output:output];
+    }];
+    [TLCryptoService benchmarkWithReport:report title:[NSString stringWithFormat:@"%@ decrypt", name] count:count operation:^int(int i) {
+        TLCryptoBox *box = [TLCryptoBox createWithKind:TLCryptoBoxKindAES_GCM];
+        if ([box bindWithKey:receiverKey peerPublicKey:senderPubKey encrypt:NO salt:salt] != 1) {
+            return 0;
+        }
+        NSMutableData *output = [[NSMutableData alloc] initWithLength:encrypted.length];
+        return [box decryptAEAD:1 data:encrypted authLength:(int)auth.length output:output];
+    }];
+}
+
+- (nonnull NSString *)developmentBenchmarkWithCount:(int)count {
+    DDLogVerbose(@"%@: developmentBenchmarkWithCount: %d", LOG_TAG, count);
+
+    if (count <= 0) {
+        count = 1;
+    }
+
+    NSMutableString *report = [[NSMutableString alloc] initWithCapacity:1024];
+    [report appendFormat:@"Crypto benchmark: %d iterations, %d bytes\n", count, BENCHMARK_DATA_SIZE];
+    [TLCryptoService benchmarkWithReport:report name:@"ECDSA" signKind:TLCryptoKindECDSA encryptKind:TLCryptoKindECDSA count:count];
+    [TLCryptoService benchmarkWithReport:report name:@"25519" signKind:TLCryptoKindED25519 encryptKind:TLCryptoKindX25519 count:count];
+
+    // Session encryption (encryptWithSessionKeyPair) only uses the AES-GCM shared secret.
+    NSData *secret = [NSData secureRandomWithLength:TL_KEY_LENGTH];
+    NSData *data = [NSData secureRandomWithLength:BENCHMARK_DATA_SIZE];
+    NSData *auth = [NSData secureRandomWithLength:24];
+    [TLCryptoService benchmarkWithReport:report title:@"session encrypt" count:count operation:^int(int i) {
+        TLCryptoBox *box = [TLCryptoBox createWithKind:TLCryptoBoxKindAES_GCM];
+        if ([box bindWithKey:secret] != 1) {
+            return 0;
+        }
+        NSMutableData *output = [[NSMutableData alloc] initWithLength:auth.length + data.length + 64];
+        return [box encryptAEAD:i + 1 data:data auth:auth output:output];
+    }];
+
+    DDLogInfo(@"%@: %@", LOG_TAG, report);
+    return report;
+}
+#endif
+
 @end
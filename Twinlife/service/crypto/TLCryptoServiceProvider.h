@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2024-2025 twinlife SA.
+ *  Copyright (c) 2024-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -36,7 +36,7 @@
 // Interface: TLCryptoServiceProvider
 //
 
-@interface TLCryptoServiceProvider : TLDatabaseServiceProvider
+@interface TLCryptoServiceProvider : TLDatabaseServiceProvider <TLKeysCleaner>
 
 - (nonnull instancetype)initWithService:(nonnull TLCryptoService *)service database:(nonnull TLDatabaseService *)database;
 
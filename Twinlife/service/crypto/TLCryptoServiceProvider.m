@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2024-2025 twinlife SA.
+ *  Copyright (c) 2024-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -79,6 +79,25 @@ static const int ddLogLevel = DDLogLevelWarning;
          " PRIMARY KEY(id, peerTwincodeId)" \
          ")"
 
+#define KEY_CACHE_SIZE 128
+#define KEY_CACHE_MAX_TAGS (4 * KEY_CACHE_SIZE)
+
+//
+// Interface: TLCryptoServiceProvider ()
+//
+
+@interface TLCryptoServiceProvider ()
+
+/// Keys and secrets loaded from the database, they are valid for the `cacheGeneration` of the database keys.
+/// The nonce sequence of a cached TLKeyInfo is never used: it is always read and reserved from the database.
+@property (readonly, nonnull) NSCache<NSString *, id> *keyCache;
+@property int64_t cacheGeneration;
+
+/// For each keys tag (twincode or repository object), the cache keys which depend on it.
+@property (readonly, nonnull) NSMutableDictionary<NSString *, NSMutableSet<NSString *> *> *cacheTags;
+
+@end
+
 //
 // Implementation: TLCryptoServiceProvider
 //
@@ -89,6 +108,12 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogVerbose(@"%@ initWithService: %@ database: %@", LOG_TAG, service, database);
 
     self = [super initWithService:service database:database sqlCreate:TWINCODE_KEYS_CREATE_TABLE table:TLDatabaseTableTwincodeKeys];
+    if (self) {
+        _keyCache = [[NSCache alloc] init];
+        _keyCache.countLimit = KEY_CACHE_SIZE;
+        _cacheTags = [[NSMutableDictionary alloc] init];
+        _cacheGeneration = [database keysGeneration];
+    }
     return self;
 }
 
@@ -157,7 +182,12 @@ static const int ddLogLevel = DDLogLevelWarning;
 - (nullable TLKeyInfo *)loadPeerEncryptionKeyWithTwincodeId:(nonnull NSUUID *)twincodeId {
     DDLogVerbose(@"%@ loadPeerEncryptionKeyWithTwincodeId: %@", LOG_TAG, twincodeId);
 
-    __block TLKeyInfo *info = nil;
+    NSString *cacheKey = [NSString stringWithFormat:@"peer:%@", twincodeId.UUIDString];
+    int64_t generation = [self.database keysGeneration];
+    __block TLKeyInfo *info = [self cachedKeyWithKey:cacheKey generation:generation];
+    if (info) {
+        return info;
+    }
     [self inDatabase:^(FMDatabase *database) {
         if (!database) {
             return;
@@ -186,6 +216,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         info = [[TLKeyInfo alloc] initWithTwincode:twincodeOutbound modificationDate:modificationDate flags:flags signingKey:signingKey encryptionKey:encryptionKey nonceSequence:0 keyIndex:0 secret:nil];
     }];
 
+    if (info) {
+        [self putCacheWithKey:cacheKey value:info generation:generation tags:@[[TLDatabaseService keysTagWithId:[info.twincodeOutbound.identifier identifierNumber] table:TLDatabaseTableTwincodeOutbound]]];
+    }
     return info;
 }
 
@@ -226,6 +259,18 @@ static const int ddLogLevel = DDLogLevelWarning;
 
     NSData *secret = ((options & (TLCryptoServiceProviderCreateSecret | TLCryptoServiceProviderCreateNextSecret | TLCryptoServiceProviderCreateFirstSecret)) != 0) ? [NSData secureRandomWithLength:TL_KEY_LENGTH] : nil;
 
+    // Without secret creation, the keys and secrets can be taken from the cache and only the nonce sequence
+    // must be reserved in the database.
+    NSString *cacheKey = nil;
+    int64_t generation = [self.database keysGeneration];
+    if (!secret) {
+        cacheKey = [NSString stringWithFormat:@"secrets:%@:%@", [twincode.identifier identifierNumber], [peerTwincode.identifier identifierNumber]];
+        TLKeyInfo *info = [self cachedKeyWithKey:cacheKey generation:generation];
+        if (info) {
+            return [self reserveWithKeyInfo:info useSequenceCount:useSequenceCount];
+        }
+    }
+
     while (true) {
         NSNumber *keyId = [twincode.identifier identifierNumber];
         NSNumber *peerId = [peerTwincode.identifier identifierNumber];
@@ -327,6 +372,9 @@ static const int ddLogLevel = DDLogLevelWarning;
 
             info = [[TLKeyInfo alloc] initWithTwincode:twincode modificationDate:modificationDate flags:flags signingKey:signingKey encryptionKey:encryptionKey nonceSequence:nonceSequence keyIndex:keyIndex secret:useSecret];
         }];
+        if (cacheKey && info) {
+            [self putCacheWithKey:cacheKey value:info generation:generation tags:@[[TLDatabaseService keysTagWithId:keyId table:TLDatabaseTableTwincodeKeys], [TLDatabaseService keysTagWithId:peerId table:TLDatabaseTableTwincodeKeys]]];
+        }
         if (!info || (useSequenceCount == 0 && !createSecret)) {
             return info;
         }
@@ -336,6 +384,7 @@ static const int ddLogLevel = DDLogLevelWarning;
             NSNumber *now = [NSNumber numberWithLongLong:[[NSDate date] timeIntervalSince1970] * 1000];
             [transaction executeUpdate:@"UPDATE twincodeKeys SET nonceSequence=?, modificationDate=? WHERE id=? AND nonceSequence=?", [NSNumber numberWithLongLong:info.nonceSequence + useSequenceCount], now, keyId, [NSNumber numberWithLongLong:info.nonceSequence]];
             if (createSecret) {
+                [transaction invalidateKeysWithId:keyId table:TLDatabaseTableSecretKeys];
                 if (secretId == nil) {
                     [transaction executeUpdate:@"INSERT OR REPLACE INTO secretKeys (id, peerTwincodeId, creationDate, modificationDate, secretUpdateDate, flags, secret1) values(?, ?, ?, ?, ?, ?, ?)", keyId, peerId, now, now, now, [NSNumber numberWithInt:secretFlags], secret];
                 } else {
@@ -373,14 +422,21 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogVerbose(@"%@ loadKeyWithTwincode: %@", LOG_TAG, twincode);
 
     NSNumber *keyId = [twincode.identifier identifierNumber];
-    __block TLKeyPair *info = nil;
+    NSString *cacheKey = [NSString stringWithFormat:@"pair:%@", keyId];
+    int64_t generation = [self.database keysGeneration];
+    __block TLKeyPair *info = [self cachedKeyWithKey:cacheKey generation:generation];
+    if (info) {
+        return info;
+    }
+    __block NSArray<NSString *> *tags = nil;
     [self inDatabase:^(FMDatabase *database) {
         if (!database) {
             return;
         }
         
         FMResultSet *resultSet = [database executeQuery:@"SELECT privKey.flags, privKey.signingKey,"
-                                  " pubKey.flags, pubKey.signingKey, twout.twincodeId, peerTwout.twincodeId, r.uuid"
+                                  " pubKey.flags, pubKey.signingKey, twout.twincodeId, peerTwout.twincodeId, r.uuid,"
+                                  " r.id, r.peerTwincodeOutbound"
                                   " FROM repository AS r"
                                   " INNER JOIN twincodeKeys AS privKey ON r.twincodeOutbound=privKey.id"
                                   " INNER JOIN twincodeKeys AS pubKey ON r.peerTwincodeOutbound=pubKey.id"
@@ -404,8 +460,16 @@ static const int ddLogLevel = DDLogLevelWarning;
         NSUUID *subjectId = [resultSet uuidForColumnIndex:6];
         if (privKey && peerPubKey && twincodeId && peerTwincodeId && subjectId) {
             info = [[TLKeyPair alloc] initWithFlags:privFlags privKey:privKey peerFlags:peerPubFlags peerPubKey:peerPubKey twincodeId:twincodeId peerTwincodeId:peerTwincodeId subjectId:subjectId];
+
+            // The key pair depends on the repository object which associates the twincodes and on their keys.
+            NSNumber *subjectDatabaseId = [NSNumber numberWithLongLong:[resultSet longLongIntForColumnIndex:7]];
+            NSNumber *peerId = [NSNumber numberWithLongLong:[resultSet longLongIntForColumnIndex:8]];
+            tags = @[[TLDatabaseService keysTagWithId:subjectDatabaseId table:TLDatabaseTableRepository], [TLDatabaseService keysTagWithId:keyId table:TLDatabaseTableTwincodeKeys], [TLDatabaseService keysTagWithId:peerId table:TLDatabaseTableTwincodeKeys]];
         }
     }];
+    if (info && tags) {
+        [self putCacheWithKey:cacheKey value:info generation:generation tags:tags];
+    }
     return info;
 }
 
@@ -646,6 +710,7 @@ static const int ddLogLevel = DDLogLevelWarning;
             secretFlags = TLCryptoServiceUseSecret2;
         }
         [transaction executeUpdate:@"UPDATE secretKeys SET secretUpdateDate=?, flags=? WHERE id=? AND peerTwincodeId=?", now, [NSNumber numberWithLong:secretFlags], keyId, peerId];
+        [transaction invalidateKeysWithId:keyId table:TLDatabaseTableSecretKeys];
 
         // Now, make sure our twincode has FLAG_ENCRYPT set.
         [transaction updateTwincodeEncryptFlagsWithTwincode:twincodeOutbound peerTwincodeOutbound:peerTwincodeOutbound now:now];
@@ -667,6 +732,7 @@ static const int ddLogLevel = DDLogLevelWarning;
     }
 
     NSNumber *now = [NSNumber numberWithLongLong:[[NSDate date] timeIntervalSince1970] * 1000];
+    [transaction invalidateKeysWithId:[twincodeOutbound.identifier identifierNumber] table:TLDatabaseTableTwincodeKeys];
     [transaction executeUpdate:@"INSERT OR IGNORE INTO twincodeKeys (id, creationDate, modificationDate, flags, signingKey, encryptionKey, nonceSequence) VALUES(?, ?, ?, ?, ?, ?, 0)", [twincodeOutbound.identifier identifierNumber], now, now, [NSNumber numberWithInt:(flags & TL_KEY_TYPE_MASK) | TL_KEY_PRIVATE_FLAG], signingKey, [TLDatabaseService toObjectWithData:encryptionKey]];
     return TLBaseServiceErrorCodeSuccess;
 }
@@ -685,4 +751,103 @@ static const int ddLogLevel = DDLogLevelWarning;
     return result;
 }
 
+#pragma mark - Private methods
+
+- (nullable id)cachedKeyWithKey:(nonnull NSString *)key generation:(int64_t)generation {
+
+    @synchronized (self.keyCache) {
+        if (generation != self.cacheGeneration) {
+            [self.keyCache removeAllObjects];
+            [self.cacheTags removeAllObjects];
+            self.cacheGeneration = generation;
+            return nil;
+        }
+        return [self.keyCache objectForKey:key];
+    }
+}
+
+- (void)putCacheWithKey:(nonnull NSString *)key value:(nonnull id)value generation:(int64_t)generation tags:(nonnull NSArray<NSString *> *)tags {
+
+    // The generation was taken before loading the value: if a transaction that changes the keys was committed
+    // since then, the value could be out of date and must not be cached.
+    @synchronized (self.keyCache) {
+        if (generation != self.cacheGeneration || generation != [self.database keysGeneration]) {
+            return;
+        }
+
+        // The NSCache can drop entries by itself and the tags are not cleaned in that case: start again
+        // with an empty cache when there are too many tags.
+        if (self.cacheTags.count >= KEY_CACHE_MAX_TAGS) {
+            [self.keyCache removeAllObjects];
+            [self.cacheTags removeAllObjects];
+        }
+        [self.keyCache setObject:value forKey:key];
+        for (NSString *tag in tags) {
+            NSMutableSet<NSString *> *keys = self.cacheTags[tag];
+            if (!keys) {
+                keys = [[NSMutableSet alloc] init];
+                self.cacheTags[tag] = keys;
+            }
+            [keys addObject:key];
+        }
+    }
+}
+
+- (void)evictKeysWithTags:(nonnull NSSet<NSString *> *)tags generation:(int64_t)generation {
+    DDLogVerbose(@"%@ evictKeysWithTags: %@ generation: %lld", LOG_TAG, tags, generation);
+
+    @synchronized (self.keyCache) {
+        // Another transaction changed the keys and we have not seen it: drop the whole cache.
+        if (generation - 1 > self.cacheGeneration) {
+            [self.keyCache removeAllObjects];
+            [self.cacheTags removeAllObjects];
+            self.cacheGeneration = generation;
+            return;
+        }
+
+        for (NSString *tag in tags) {
+            NSSet<NSString *> *keys = self.cacheTags[tag];
+            if (keys) {
+                for (NSString *key in keys) {
+                    [self.keyCache removeObjectForKey:key];
+                }
+                [self.cacheTags removeObjectForKey:tag];
+            }
+        }
+        if (generation > self.cacheGeneration) {
+            self.cacheGeneration = generation;
+        }
+    }
+}
+
+- (nullable TLKeyInfo *)reserveWithKeyInfo:(nonnull TLKeyInfo *)keyInfo useSequenceCount:(long)useSequenceCount {
+    DDLogVerbose(@"%@ reserveWithKeyInfo: %@ useSequenceCount: %ld", LOG_TAG, keyInfo, useSequenceCount);
+
+    NSNumber *keyId = [keyInfo.twincodeOutbound.identifier identifierNumber];
+    __block TLKeyInfo *info = nil;
+    [self inTransaction:^(TLTransaction *transaction) {
+        if (!transaction) {
+            return;
+        }
+
+        FMResultSet *resultSet = [transaction executeQuery:@"SELECT nonceSequence FROM twincodeKeys WHERE id=?", keyId];
+        if (!resultSet) {
+            [self.service onDatabaseErrorWithError:[transaction lastError] line:__LINE__];
+            return;
+        }
+        if (![resultSet next]) {
+            return;
+        }
+
+        int64_t nonceSequence = [resultSet longLongIntForColumnIndex:0];
+        if (useSequenceCount > 0) {
+            NSNumber *now = [NSNumber numberWithLongLong:[[NSDate date] timeIntervalSince1970] * 1000];
+            [transaction executeUpdate:@"UPDATE twincodeKeys SET nonceSequence=?, modificationDate=? WHERE id=? AND nonceSequence=?", [NSNumber numberWithLongLong:nonceSequence + useSequenceCount], now, keyId, [NSNumber numberWithLongLong:nonceSequence]];
+            [transaction commit];
+        }
+        info = [[TLKeyInfo alloc] initWithKeyInfo:keyInfo nonceSequence:nonceSequence];
+    }];
+    return info;
+}
+
 @end
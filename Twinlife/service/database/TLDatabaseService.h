@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2023-2025 twinlife SA.
+ *  Copyright (c) 2023-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -79,6 +79,8 @@
 
 - (void)filterName:(nullable NSString *)name field:(nonnull NSString *)field;
 
+- (void)filterPrefix:(nullable NSString *)prefix field:(nonnull NSString *)field;
+
 - (void)filterUUID:(nullable NSUUID *)uuid field:(nonnull NSString *)field;
 
 - (void)filterLong:(long)value field:(nonnull NSString *)field;
@@ -185,6 +187,18 @@
 
 @end
 
+//
+// Interface: TLKeysCleaner
+//
+
+@protocol TLKeysCleaner
+
+/// Remove from the keys cache the entries which depend on one of the keys tags (see `keysTagWithId`).
+/// It is called when a transaction that modified them is committed, `generation` is the new keys generation.
+- (void)evictKeysWithTags:(nonnull NSSet<NSString *> *)tags generation:(int64_t)generation;
+
+@end
+
 //
 // Interface: TLTransaction
 //
@@ -200,6 +214,14 @@
 /// Delete the object from its associated database table and remove it from the cache.
 - (void)deleteWithObject:(nonnull id<TLDatabaseObject>)object;
 
+/// Record that the transaction modifies the twincode keys or secrets: the keys cached in memory are
+/// invalidated when the transaction is committed.
+- (void)invalidateKeys;
+
+/// Record that the transaction modifies the keys, secrets or flags of the twincode or the twincodes of the
+/// repository object: only the keys cached for them are invalidated when the transaction is committed.
+- (void)invalidateKeysWithId:(nonnull NSNumber *)databaseId table:(TLDatabaseTable)table;
+
 /// Delete from the database table the object with the given uuid.
 /// The object is also removed from the cache if it was present.
 - (void)deleteWithId:(nonnull NSUUID*)objectId table:(TLDatabaseTable)table;
@@ -321,6 +343,13 @@
 /// Remove from the cache the object with the given uuid.
 - (void)evictCacheWithObjectId:(nullable NSUUID *)objectId;
 
+/// Get the generation of the twincode keys and secrets, it changes each time a transaction that modifies them is committed.
+- (int64_t)keysGeneration;
+
+/// Get the tag identifying the keys that depend on the twincode (twincodeOutbound, twincodeKeys and secretKeys
+/// tables share the same id) or on the repository object.  Returns nil for other tables.
++ (nullable NSString *)keysTagWithId:(nonnull NSNumber *)databaseId table:(TLDatabaseTable)table;
+
 - (nullable TLTwincodeInbound *)loadTwincodeInboundWithResultSet:(nonnull FMResultSet *)resultSet offset:(int)offset;
 
 - (nullable TLTwincodeOutbound *)loadTwincodeOutboundWithResultSet:(nonnull FMResultSet *)resultSet offset:(int)offset;
@@ -1,11 +1,13 @@
 /*
- *  Copyright (c) 2023-2024 twinlife SA.
+ *  Copyright (c) 2023-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
  *   Stephane Carrez (Stephane.Carrez@twin.life)
  */
 
+#include <stdatomic.h>
+
 #import <CocoaLumberjack.h>
 
 #import <FMDatabaseAdditions.h>
@@ -67,6 +69,8 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property (readonly, nonnull) NSArray<TLDatabaseAllocator *> *allocatorIds;
 @property (nullable) FMDatabase *database;
 @property (nullable) NSMutableArray<TLDatabaseAllocator *> *usedAllocators;
+@property BOOL keysModified;
+@property (nullable) NSMutableSet<NSString *> *modifiedKeys;
 
 - (nonnull instancetype)initWithDatabaseService:(nonnull TLDatabaseService *)databaseService;
 
@@ -89,9 +93,15 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property (nullable) id<TLConversationsCleaner> conversationsCleaner;
 @property (nullable) id<TLImagesCleaner> imagesCleaner;
 @property (nullable) id<TLTwincodesCleaner> twincodesCleaner;
+@property (nullable) id<TLKeysCleaner> keysCleaner;
+@property atomic_llong keysGenerationCounter;
 
 + (nullable NSString *)getTableNameWithTable:(TLDatabaseTable)table;
 
+- (void)onKeysChanged;
+
+- (void)onKeysChangedWithTags:(nonnull NSSet<NSString *> *)tags;
+
 // - (nullable TLDatabaseIdentifier *)getCachedIdentifier:(nonnull NSUUID *)objectId;
 
 @end
@@ -106,6 +116,8 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property (nonnull, readonly) NSMutableArray<NSObject *> *params;
 @property BOOL hasWhere;
 
+- (void)filterLike:(nonnull NSString *)name prefix:(nonnull NSString *)prefix suffix:(nonnull NSString *)suffix field:(nonnull NSString *)field;
+
 @end
 
 //
@@ -223,23 +235,37 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)filterName:(nullable NSString *)name field:(nonnull NSString *)field {
     
     if (name) {
-        [self inWhere];
-        [self.query appendString:field];
-        [self.query appendString:@" LIKE ?"];
-
-        // If the text to search contains a '%' we have to escape it (using '%' as escape failed for me).
-        // Use the '^' as the escape character but if it occurs, we must also escape it.
-        if ([field containsString:@"%"]) {
-            name = [name stringByReplacingOccurrencesOfString:@"^" withString:@"^^"];
-            name = [name stringByReplacingOccurrencesOfString:@"%" withString:@"^%"];
-            [self.query appendString:@" ESCAPE '^'"];
-        }
-
         // Enclose the search text with the '%' pattern (similar to .* in regex).
-        [self.params addObject:[NSString stringWithFormat:@"%%%@%%", name]];
+        [self filterLike:name prefix:@"%" suffix:@"%" field:field];
     }
 }
 
+- (void)filterPrefix:(nullable NSString *)prefix field:(nonnull NSString *)field {
+    
+    if (prefix) {
+        [self filterLike:prefix prefix:@"" suffix:@"%" field:field];
+    }
+}
+
+- (void)filterLike:(nonnull NSString *)name prefix:(nonnull NSString *)prefix suffix:(nonnull NSString *)suffix field:(nonnull NSString *)field {
+    
+    [self inWhere];
+    [self.query appendString:field];
+    [self.query appendString:@" LIKE ?"];
+
+    // If the text to search contains a '%' or '_' we have to escape it (using '%' as escape failed for me).
+    // Use the '^' as the escape character but if it occurs, we must also escape it (and first).
+    if ([name containsString:@"%"] || [name containsString:@"_"] || [name containsString:@"^"]) {
+        name = [name stringByReplacingOccurrencesOfString:@"^" withString:@"^^"];
+        name = [name stringByReplacingOccurrencesOfString:@"%" withString:@"^%"];
+        name = [name stringByReplacingOccurrencesOfString:@"_" withString:@"^_"];
+        [self.query appendString:@" ESCAPE '^'"];
+    }
+
+    // The search text must not be used as a format string.
+    [self.params addObject:[[prefix stringByAppendingString:name] stringByAppendingString:suffix]];
+}
+
 - (void)filterUUID:(nullable NSUUID *)uuid field:(nonnull NSString *)field {
     
     if (uuid) {
@@ -552,6 +578,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
     DDLogVerbose(@"%@ deleteWithObject: %@", LOG_TAG, object);
     
     TLDatabaseIdentifier *identifier = object.identifier;
+    [self invalidateKeysWithId:[identifier identifierNumber] table:[identifier databaseTable]];
     NSString *tableName = [TLDatabaseService getTableNameWithTable:[identifier databaseTable]];
     if (tableName) {
         @synchronized (self.databaseService) {
@@ -564,6 +591,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)deleteWithId:(nonnull NSUUID*)objectId table:(TLDatabaseTable) table {
     DDLogVerbose(@"%@ deleteWithId: %@ table: %d", LOG_TAG, objectId, table);
     
+    [self invalidateKeysWithTable:table];
     NSString *tableName = [TLDatabaseService getTableNameWithTable:table];
     if (tableName) {
         @synchronized (self.databaseService) {
@@ -579,6 +607,9 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)deleteWithList:(nonnull NSArray<NSNumber *> *)list table:(TLDatabaseTable)table {
     DDLogVerbose(@"%@ deleteWithList: %@ table: %d", LOG_TAG, list, table);
     
+    for (NSNumber *databaseId in list) {
+        [self invalidateKeysWithId:databaseId table:table];
+    }
     NSString *tableName = [TLDatabaseService getTableNameWithTable:table];
     if (tableName) {
         @synchronized (self.databaseService) {
@@ -592,6 +623,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)deleteWithDatabaseId:(int64_t)databaseId table:(TLDatabaseTable)table {
     DDLogVerbose(@"%@ deleteWithDatabaseId: %lld table: %d", LOG_TAG, databaseId, table);
     
+    [self invalidateKeysWithId:[NSNumber numberWithLongLong:databaseId] table:table];
     NSString *tableName = [TLDatabaseService getTableNameWithTable:table];
     if (tableName) {
         @synchronized (self.databaseService) {
@@ -621,6 +653,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)deleteTwincodeWithTwincodeOutbound:(nonnull TLTwincodeOutbound *)twincodeOutbound {
     DDLogVerbose(@"%@ deleteTwincodeWithTwincodeOutbound: %@", LOG_TAG, twincodeOutbound);
     
+    [self invalidateKeysWithId:[twincodeOutbound.identifier identifierNumber] table:TLDatabaseTableTwincodeOutbound];
     [self.databaseService.twincodesCleaner deleteTwincodeWithTransaction:self twincodeOutbound:twincodeOutbound];
 }
 
@@ -707,6 +740,8 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)saveSecretKeyWithKeyId:(nonnull NSNumber *)keyId keyIndex:(int)keyIndex secretKey:(nonnull NSData *)secretKey now:(nonnull NSNumber *)now {
     DDLogVerbose(@"%@ saveSecretKeyWithKeyId: %@ keyIndex: %d secretKey: %@ now: %@", LOG_TAG, keyId, keyIndex, secretKey, now);
 
+    [self invalidateKeysWithId:keyId table:TLDatabaseTableSecretKeys];
+
     // Either insert or update the secret key.
     // Flags are always 0 and peerTwincodeId is always NULL because this is the peer secret.
     // Note: we cannot use the insert() to detect if the row existed because the secretKeys table
@@ -733,6 +768,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
     DDLogVerbose(@"%@ storePublicKeyWithTwincode: %@ flags: %d pubSigningKey: %@ keyIndex: %d", LOG_TAG, twincodeOutbound, flags, pubSigningKey, keyIndex);
     
     NSNumber *keyId = [twincodeOutbound.identifier identifierNumber];
+    [self invalidateKeysWithId:keyId table:TLDatabaseTableTwincodeKeys];
     NSNumber *now = [NSNumber numberWithLongLong:[[NSDate date] timeIntervalSince1970] * 1000];
     NSObject *encryptionKey = [TLDatabaseService toObjectWithData:pubEncryptionKey];
     [self executeUpdate:@"INSERT OR REPLACE INTO twincodeKeys (id, creationDate, modificationDate, flags, signingKey, encryptionKey) VALUES(?, ?, ?, ?, ?, ?)", keyId, now, now, [NSNumber numberWithInt:flags], pubSigningKey, encryptionKey];
@@ -758,6 +794,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
         if ((twincodeFlags & FLAG_ENCRYPT) == 0) {
             twincodeFlags |= FLAG_ENCRYPT;
                     
+            [self invalidateKeysWithId:twincodeId table:TLDatabaseTableTwincodeOutbound];
             [self executeUpdate:@"UPDATE twincodeOutbound SET flags=?, modificationDate=? WHERE id=?", [NSNumber numberWithInt:twincodeFlags], now, twincodeId];
             twincodeOutbound.flags = twincodeFlags;
             twincodeOutbound.modificationDate = now.longLongValue;
@@ -768,6 +805,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
         if ((peerTwincodeFlags & FLAG_ENCRYPT) == 0) {
             peerTwincodeFlags |= FLAG_ENCRYPT;
                     
+            [self invalidateKeysWithId:peerId table:TLDatabaseTableTwincodeOutbound];
             [self executeUpdate:@"UPDATE twincodeOutbound SET flags=?, modificationDate=? WHERE id=?", [NSNumber numberWithInt:peerTwincodeFlags], now, peerId];
             peerTwincodeOutbound.flags = peerTwincodeFlags;
             peerTwincodeOutbound.modificationDate = now.longLongValue;
@@ -889,10 +927,51 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
     return [self.database changes];
 }
 
+- (void)invalidateKeys {
+    DDLogVerbose(@"%@ invalidateKeys", LOG_TAG);
+
+    self.keysModified = YES;
+}
+
+- (void)invalidateKeysWithId:(nonnull NSNumber *)databaseId table:(TLDatabaseTable)table {
+
+    NSString *tag = [TLDatabaseService keysTagWithId:databaseId table:table];
+    if (tag) {
+        if (!self.modifiedKeys) {
+            self.modifiedKeys = [[NSMutableSet alloc] init];
+        }
+        [self.modifiedKeys addObject:tag];
+    }
+}
+
+- (void)invalidateKeysWithTable:(TLDatabaseTable)table {
+
+    switch (table) {
+        case TLDatabaseTableTwincodeOutbound:
+        case TLDatabaseTableTwincodeKeys:
+        case TLDatabaseTableSecretKeys:
+        case TLDatabaseTableRepository:
+            self.keysModified = YES;
+            break;
+
+        default:
+            break;
+    }
+}
+
 - (void)commit {
     
     [self.database commit];
     self.usedAllocators = nil;
+    if (self.keysModified) {
+        self.keysModified = NO;
+        self.modifiedKeys = nil;
+        [self.databaseService onKeysChanged];
+    } else if (self.modifiedKeys) {
+        NSSet<NSString *> *tags = self.modifiedKeys;
+        self.modifiedKeys = nil;
+        [self.databaseService onKeysChangedWithTags:tags];
+    }
     if (!self.database.isInTransaction) {
         [self.database beginTransaction];
     }
@@ -913,6 +992,8 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)rollback {
     DDLogVerbose(@"%@ rollback", LOG_TAG);
 
+    self.keysModified = NO;
+    self.modifiedKeys = nil;
     @synchronized (self.databaseService) {
         if (self.usedAllocators) {
             // Force a reload of the allocators because the transaction was aborted
@@ -1052,6 +1133,8 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
         self.imagesCleaner = (id<TLImagesCleaner>) service;
     } else if ([service conformsToProtocol:@protocol(TLTwincodesCleaner)]) {
         self.twincodesCleaner = (id<TLTwincodesCleaner>) service;
+    } else if ([service conformsToProtocol:@protocol(TLKeysCleaner)]) {
+        self.keysCleaner = (id<TLKeysCleaner>) service;
     }
 }
 
@@ -1092,6 +1175,40 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
     }];
 }
 
+- (int64_t)keysGeneration {
+
+    return atomic_load(&_keysGenerationCounter);
+}
+
+- (void)onKeysChanged {
+    DDLogVerbose(@"%@ onKeysChanged", LOG_TAG);
+
+    atomic_fetch_add(&_keysGenerationCounter, 1);
+}
+
+- (void)onKeysChangedWithTags:(nonnull NSSet<NSString *> *)tags {
+    DDLogVerbose(@"%@ onKeysChangedWithTags: %@", LOG_TAG, tags);
+
+    int64_t generation = atomic_fetch_add(&_keysGenerationCounter, 1) + 1;
+    [self.keysCleaner evictKeysWithTags:tags generation:generation];
+}
+
++ (nullable NSString *)keysTagWithId:(nonnull NSNumber *)databaseId table:(TLDatabaseTable)table {
+
+    switch (table) {
+        case TLDatabaseTableTwincodeOutbound:
+        case TLDatabaseTableTwincodeKeys:
+        case TLDatabaseTableSecretKeys:
+            return [NSString stringWithFormat:@"t:%@", databaseId];
+
+        case TLDatabaseTableRepository:
+            return [NSString stringWithFormat:@"r:%@", databaseId];
+
+        default:
+            return nil;
+    }
+}
+
 - (void)onOpenWithDatabaseQueue:(nonnull FMDatabaseQueue *)databaseQueue {
     DDLogVerbose(@"%@ onOpenWithDatabaseQueue: %@", LOG_TAG, databaseQueue);
     
@@ -1194,6 +1311,7 @@ TL_CREATE_ASSERT_POINT(DATABASE_UPDATE_ERROR, 22)
 - (void)onCloseDatabase {
     DDLogVerbose(@"%@ onCloseDatabase", LOG_TAG);
 
+    [self onKeysChanged];
     @synchronized (self) {
         // When caches are disabled, clear the cached before suspending to release the memory.
         if (!self.twinlife.twinlifeConfiguration.enableCaches) {
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -28,7 +28,10 @@
 
 @property (readonly, nonnull) NSUUID *imageId;
 @property (readonly) TLImageServiceKind kind;
+@property (readonly) int64_t offset;
 
 - (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId imageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind;
 
+- (nonnull instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId imageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind offset:(int64_t)offset;
+
 @end
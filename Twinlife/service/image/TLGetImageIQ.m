@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -15,6 +15,25 @@
 /**
  * Get image IQ.
  *
+ * Schema version 2
+ * <pre>
+ * {
+ *  "schemaId":"3a9ca7c4-6153-426d-b716-d81fd625293c",
+ *  "schemaVersion":"2",
+ *
+ *  "type":"record",
+ *  "name":"GetImageIQ",
+ *  "namespace":"org.twinlife.schemas.image",
+ *  "super":"org.twinlife.schemas.BinaryPacketIQ"
+ *  "fields": [
+ *     {"name":"imageId", "type":"uuid"},
+ *     {"name":"kind", ["normal", "thumbnail", "large"]},
+ *     {"name":"offset", "type":"long"}
+ *  ]
+ * }
+ *
+ * </pre>
+ *
  * Schema version 1
  * <pre>
  * {
@@ -64,6 +83,9 @@
             [encoder writeEnum:2];
             break;
     }
+    if (self.schemaVersion >= 2) {
+        [encoder writeLong:getImageIQ.offset];
+    }
 }
 
 - (NSObject *)deserializeWithSerializerFactory:(TLSerializerFactory *)serializerFactory decoder:(id<TLDecoder>)decoder {
@@ -81,11 +103,17 @@
 
 - (instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId imageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind {
 
+    return [self initWithSerializer:serializer requestId:requestId imageId:imageId kind:kind offset:0];
+}
+
+- (instancetype)initWithSerializer:(nonnull TLBinaryPacketIQSerializer *)serializer requestId:(int64_t)requestId imageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind offset:(int64_t)offset {
+
     self = [super initWithSerializer:serializer requestId:requestId];
     
     if (self) {
         _imageId = imageId;
         _kind = kind;
+        _offset = offset;
     }
     return self;
 }
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020-2025 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -25,6 +25,16 @@
 
 @end
 
+//
+// Interface: TLImageCacheStats ()
+//
+
+@interface TLImageCacheStats ()
+
+- (nonnull instancetype)initWithMemoryHits:(int64_t)memoryHits diskHits:(int64_t)diskHits misses:(int64_t)misses;
+
+@end
+
 typedef void (^TLImageConsumer) (TLBaseServiceErrorCode status, UIImage * _Nullable image);
 
 typedef void (^TLImageIdConsumer) (TLBaseServiceErrorCode status, TLImageId * _Nullable imageId);
@@ -52,11 +62,29 @@ typedef void (^TLImageExportedIdConsumer) (TLBaseServiceErrorCode status, TLExpo
 @property (readonly, nullable) TLImageIdConsumer imageIdConsumer;
 @property (nullable) NSMutableData *imageReceived;
 @property (nullable) TLGetImagePendingRequest *nextRequest; // Next request for this same image.
+@property int64_t offset;                     // Offset from which the server sends the image.
+@property (nullable) NSString *partPath;      // Partial file for normal and large images received in several chunks.
+@property (nullable) NSFileHandle *partFile;
 
 -(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId publicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind withBlock:(nonnull TLImageConsumer)block;
 
 - (void)dispatchWithErrorCode:(TLBaseServiceErrorCode)errorCode image:(nullable UIImage *)image;
 
+- (void)closePart;
+
+@end
+
+//
+// Interface: TLImagePrefetch ()
+//
+
+@interface TLImagePrefetch : NSObject
+
+@property (readonly, nonnull) TLImageId *imageId;
+@property (readonly) TLImageServiceKind kind;
+
+-(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind;
+
 @end
 
 //
@@ -87,10 +115,18 @@ typedef void (^TLImageExportedIdConsumer) (TLBaseServiceErrorCode status, TLExpo
 @property (readonly, nonnull) TLImageId *imageId;
 @property (readonly) TLImageServiceKind kind;
 @property (readonly) int64_t totalLength;
-@property (readonly, nonnull) NSMutableArray<TLPutImageIQ *> *queue;
+@property (readonly) int64_t requestId;
+@property (readonly) int64_t chunkSize;
 @property int sendCount;
 
--(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind totalLength:(int64_t)totalLength;
+-(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind totalLength:(int64_t)totalLength requestId:(int64_t)requestId fileHandle:(nonnull NSFileHandle *)fileHandle offset:(int64_t)offset chunkSize:(int64_t)chunkSize;
+
+/// Read the next chunk of the image from the file and return the offset of that chunk.
+/// Returns nil when the whole file was read, or with an error code when the file cannot be read.
+- (nullable NSData *)readChunkWithOffset:(nonnull int64_t *)offset errorCode:(nonnull TLBaseServiceErrorCode *)errorCode;
+
+/// Close the image file when the upload is finished.
+- (void)close;
 
 @end
 
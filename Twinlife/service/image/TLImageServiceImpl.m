@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020-2025 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -41,26 +41,47 @@
 #define DEFAULT_CHUNK_SIZE (32768) // Be conservative and use a default < 64K.
 
 #define MAX_IMAGE_SIZE     (4*1024*1024) // 4Mb PNG/JPG file max
+
+// The memory caches are limited by the size of the decoded images and the disk cache by the size of the files.
+// When the disk cache is full, the least recently used files are removed to keep 3/4 of the limit.
+#define MAX_THUMBNAIL_CACHE_COST  (8*1024*1024)
+#define MAX_IMAGE_CACHE_COST      (48*1024*1024)
+#define MAX_DISK_CACHE_SIZE       (128*1024*1024)
+
 #define IMAGE_JPEG_QUALITY 0.9
 
-// Send 2 PutImageIQ and queue the others until we get a response and then proceed with sending more.
+// Send 2 PutImageIQ and read the next chunks from the file when we get a response to proceed with sending more.
 // - if the value is too big, this delays the execution of other operations (creation and update of twincode),
 // - if the value is too small (min is 1), sending the image will take more time.
 // 2 seems to give a good balance between the two.
 #define MAX_SEND_IMAGE_IQ  2
 
+// Default number of GetImageIQ that a prefetch sends before waiting for a response.
+#define DEFAULT_MAX_PREFETCH_REQUESTS 4
+
+// Number of times we ask to continue a partial download without an answer before we drop the partial file
+// and ask for the whole image (the server may not know the GetImageIQ version 2 and not reply).
+#define MAX_RESUME_ATTEMPTS 3
+
+typedef enum {
+    TLImageCacheLevelMemory,
+    TLImageCacheLevelDisk,
+    TLImageCacheLevelMiss
+} TLImageCacheLevel;
+
 #if 0
 static const int ddLogLevel = DDLogLevelVerbose;
 #else
 static const int ddLogLevel = DDLogLevelWarning;
 #endif
 
-#define IMAGE_SERVICE_VERSION @"2.0.3"
+#define IMAGE_SERVICE_VERSION @"2.1.0"
 
 static TLBinaryPacketIQSerializer *IQ_COPY_IMAGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_CREATE_IMAGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_DELETE_IMAGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_GET_IMAGE_SERIALIZER = nil;
+static TLBinaryPacketIQSerializer *IQ_GET_IMAGE_RANGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_PUT_IMAGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_ON_COPY_IMAGE_SERIALIZER = nil;
 static TLBinaryPacketIQSerializer *IQ_ON_CREATE_IMAGE_SERIALIZER = nil;
@@ -90,6 +111,12 @@ static TLBinaryPacketIQSerializer *IQ_ON_PUT_IMAGE_SERIALIZER = nil;
 @property (readonly, nonnull) TLImageJob *imageJob;
 @property (readonly, nonnull) TLImageServiceProvider *serviceProvider;
 @property (readonly, nonnull) NSMutableDictionary<NSNumber *, TLImagePendingRequest *> *pendingRequests;
+@property (readonly, nonnull) NSMutableDictionary<NSString *, TLGetImagePendingRequest *> *getImageRequests;
+@property (readonly, nonnull) NSMutableDictionary<NSString *, NSNumber *> *resumeAttempts;
+@property (readonly, nonnull) NSMutableArray<TLImagePrefetch *> *prefetchQueue;
+@property int prefetchCount;
+@property BOOL prefetchRunning;
+@property int maxPrefetchRequests;
 @property (readonly, nonnull) TLSerializerFactory *serializerFactory;
 @property (readonly) int64_t maxImageSize;
 @property BOOL checkUpload;
@@ -98,6 +125,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_PUT_IMAGE_SERIALIZER = nil;
 @property (nullable) TLUploadImagePendingRequest *uploadRequest;
 
 /// Cache for the thumbnail and cache for large images.  The NSCache is thread safe.
+/// The cost of an image is the size of its decoded bitmap.
 @property (readonly, nonnull) NSCache<TLImageId *, UIImage *> *thumbnailCache;
 @property (readonly, nonnull) NSCache<TLImageId *, UIImage *> *imageCache;
 
@@ -105,6 +133,23 @@ static TLBinaryPacketIQSerializer *IQ_ON_PUT_IMAGE_SERIALIZER = nil;
 
 - (void)backgroundUpload;
 
+/// Returns YES when an image upload is in progress.
+- (BOOL)isUploading;
+
+- (void)cacheWithImage:(nonnull UIImage *)image imageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind;
+
+- (void)countWithKind:(TLImageServiceKind)kind level:(TLImageCacheLevel)level;
+
+- (void)sendGetImageWithImageId:(nonnull TLImageId *)imageId publicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind withBlock:(nonnull TLImageConsumer)block;
+
+- (void)removeGetImageRequest:(nonnull TLGetImagePendingRequest *)request;
+
+- (void)abortGetImageWithRequestId:(nonnull NSNumber *)lRequestId request:(nonnull TLGetImagePendingRequest *)request errorCode:(TLBaseServiceErrorCode)errorCode;
+
+- (BOOL)writePartWithRequest:(nonnull TLGetImagePendingRequest *)request iq:(nonnull TLOnGetImageIQ *)iq;
+
+- (void)prefetchNext;
+
 @end
 
 //
@@ -143,6 +188,11 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     [self.service backgroundUpload];
 }
 
+- (BOOL)isJobRunning {
+
+    return [self.service isUploading];
+}
+
 @end
 
 //
@@ -228,7 +278,44 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
 - (nonnull instancetype)init {
     DDLogVerbose(@"%@ init", LOG_TAG);
     
-    return [super initWithBaseServiceId:TLBaseServiceIdImageService version:[TLImageService VERSION] serviceOn:NO];
+    self = [super initWithBaseServiceId:TLBaseServiceIdImageService version:[TLImageService VERSION] serviceOn:NO];
+    if (self) {
+        _maxPrefetchRequests = DEFAULT_MAX_PREFETCH_REQUESTS;
+    }
+    return self;
+}
+
+@end
+
+//
+// Implementation: TLImageCacheStats
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLImageCacheStats"
+
+@implementation TLImageCacheStats
+
+- (nonnull instancetype)initWithMemoryHits:(int64_t)memoryHits diskHits:(int64_t)diskHits misses:(int64_t)misses {
+
+    self = [super init];
+    if (self) {
+        _memoryHits = memoryHits;
+        _diskHits = diskHits;
+        _misses = misses;
+    }
+    return self;
+}
+
+- (double)hitRatio {
+
+    int64_t total = self.memoryHits + self.diskHits + self.misses;
+    return total > 0 ? (double)(self.memoryHits + self.diskHits) / (double)total : 0.0;
+}
+
+- (nonnull NSString *)description {
+
+    return [NSString stringWithFormat:@"TLImageCacheStats[memory=%lld disk=%lld miss=%lld ratio=%.2f]", self.memoryHits, self.diskHits, self.misses, [self hitRatio]];
 }
 
 @end
@@ -262,6 +349,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         _kind = kind;
         _imageConsumer = block;
         _nextRequest = nil;
+        _offset = 0;
     }
     return self;
 }
@@ -277,6 +365,35 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     } while (request != nil);
 }
 
+- (void)closePart {
+
+    if (self.partFile) {
+        [self.partFile closeFile];
+        self.partFile = nil;
+    }
+}
+
+@end
+
+//
+// Implementation: TLImagePrefetch
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLImagePrefetch"
+
+@implementation TLImagePrefetch
+
+-(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind {
+    
+    self = [super init];
+    if (self) {
+        _imageId = imageId;
+        _kind = kind;
+    }
+    return self;
+}
+
 @end
 
 //
@@ -286,21 +403,86 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
 #undef LOG_TAG
 #define LOG_TAG @"TLUploadImagePendingRequest"
 
-@implementation TLUploadImagePendingRequest
+@implementation TLUploadImagePendingRequest {
+    NSFileHandle *_fileHandle;
+    int64_t _nextOffset;
+}
 
--(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind totalLength:(int64_t)totalLength {
+-(nonnull instancetype)initWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind totalLength:(int64_t)totalLength requestId:(int64_t)requestId fileHandle:(nonnull NSFileHandle *)fileHandle offset:(int64_t)offset chunkSize:(int64_t)chunkSize {
     
     self = [super init];
     if (self) {
         _imageId = imageId;
         _kind = kind;
         _totalLength = totalLength;
+        _requestId = requestId;
+        _chunkSize = chunkSize;
         _sendCount = 0;
-        _queue = [[NSMutableArray alloc] initWithCapacity:32];
+        _fileHandle = fileHandle;
+        _nextOffset = offset;
     }
     return self;
 }
 
+- (nullable NSData *)readChunkWithOffset:(nonnull int64_t *)offset errorCode:(nonnull TLBaseServiceErrorCode *)errorCode {
+    DDLogVerbose(@"%@ readChunkWithOffset", LOG_TAG);
+
+    @synchronized (self) {
+        *errorCode = TLBaseServiceErrorCodeSuccess;
+        if (!_fileHandle || _nextOffset >= _totalLength) {
+            return nil;
+        }
+
+        int64_t size = _totalLength - _nextOffset;
+        if (size > _chunkSize) {
+            size = _chunkSize;
+        }
+        // The seekToFileOffset and readDataOfLength raise an exception on I/O errors.
+        NSData *data = nil;
+        if (@available(iOS 13.0, *)) {
+            NSError *error = nil;
+            if (![_fileHandle seekToOffset:(unsigned long long)_nextOffset error:&error]) {
+                DDLogError(@"%@ seek failed: %@", LOG_TAG, error);
+                *errorCode = TLBaseServiceErrorCodeFileNotFound;
+                return nil;
+            }
+            data = [_fileHandle readDataUpToLength:(NSUInteger)size error:&error];
+            if (!data) {
+                DDLogError(@"%@ read failed: %@", LOG_TAG, error);
+                *errorCode = TLBaseServiceErrorCodeFileNotFound;
+                return nil;
+            }
+        } else {
+            @try {
+                [_fileHandle seekToFileOffset:_nextOffset];
+                data = [_fileHandle readDataOfLength:(NSUInteger)size];
+            } @catch (NSException *exception) {
+                DDLogError(@"%@ read exception: %@", LOG_TAG, exception);
+                *errorCode = TLBaseServiceErrorCodeFileNotFound;
+                return nil;
+            }
+        }
+
+        // The file is shorter than the size we are uploading: it was truncated.
+        if (data.length == 0) {
+            *errorCode = TLBaseServiceErrorCodeFileNotFound;
+            return nil;
+        }
+        *offset = _nextOffset;
+        _nextOffset += data.length;
+        return data;
+    }
+}
+
+- (void)close {
+    DDLogVerbose(@"%@ close", LOG_TAG);
+
+    @synchronized (self) {
+        [_fileHandle closeFile];
+        _fileHandle = nil;
+    }
+}
+
 @end
 
 //
@@ -391,7 +573,9 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
 #undef LOG_TAG
 #define LOG_TAG @"TLImageService"
 
-@implementation TLImageService
+@implementation TLImageService {
+    int64_t _cacheCounters[3][3]; // Indexed by TLImageServiceKind and TLImageCacheLevel.
+}
 
 + (void)initialize {
     
@@ -399,6 +583,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     IQ_CREATE_IMAGE_SERIALIZER = [[TLCreateImageIQSerializer alloc] initWithSchema:CREATE_IMAGE_SCHEMA_ID schemaVersion:2];
     IQ_DELETE_IMAGE_SERIALIZER = [[TLDeleteImageIQSerializer alloc] initWithSchema:DELETE_IMAGE_SCHEMA_ID schemaVersion:1];
     IQ_GET_IMAGE_SERIALIZER = [[TLGetImageIQSerializer alloc] initWithSchema:GET_IMAGE_SCHEMA_ID schemaVersion:1];
+    IQ_GET_IMAGE_RANGE_SERIALIZER = [[TLGetImageIQSerializer alloc] initWithSchema:GET_IMAGE_SCHEMA_ID schemaVersion:2];
     IQ_PUT_IMAGE_SERIALIZER = [[TLPutImageIQSerializer alloc] initWithSchema:PUT_IMAGE_SCHEMA_ID schemaVersion:1];
     
     IQ_ON_COPY_IMAGE_SERIALIZER = [[TLOnCopyImageIQSerializer alloc] initWithSchema:ON_COPY_IMAGE_SCHEMA_ID schemaVersion:1];
@@ -420,8 +605,16 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     
     _serviceProvider = [[TLImageServiceProvider alloc] initWithService:self database:twinlife.databaseService];
     _pendingRequests = [[NSMutableDictionary alloc] init];
+    _getImageRequests = [[NSMutableDictionary alloc] init];
+    _resumeAttempts = [[NSMutableDictionary alloc] init];
+    _prefetchQueue = [[NSMutableArray alloc] init];
+    _prefetchCount = 0;
+    _prefetchRunning = NO;
+    _maxPrefetchRequests = DEFAULT_MAX_PREFETCH_REQUESTS;
     _thumbnailCache = [[NSCache alloc] init];
+    _thumbnailCache.totalCostLimit = MAX_THUMBNAIL_CACHE_COST;
     _imageCache = [[NSCache alloc] init];
+    _imageCache.totalCostLimit = MAX_IMAGE_CACHE_COST;
     _serializerFactory = self.twinlife.serializerFactory;
     _maxImageSize = MAX_IMAGE_SIZE;
     _uploadChunkSize = DEFAULT_CHUNK_SIZE;
@@ -460,6 +653,8 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     TLImageServiceConfiguration* imageServiceConfiguration = [[TLImageServiceConfiguration alloc] init];
     TLImageServiceConfiguration* serviceConfiguration = (TLImageServiceConfiguration *) baseServiceConfiguration;
     imageServiceConfiguration.serviceOn = serviceConfiguration.isServiceOn;
+    imageServiceConfiguration.maxPrefetchRequests = MAX(1, serviceConfiguration.maxPrefetchRequests);
+    self.maxPrefetchRequests = imageServiceConfiguration.maxPrefetchRequests;
     self.configured = YES;
     self.serviceConfiguration = imageServiceConfiguration;
     self.serviceOn = imageServiceConfiguration.isServiceOn;
@@ -490,6 +685,21 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         [self.uploadJob cancel];
         self.uploadJob = nil;
     }
+
+    // Drop the prefetches not yet started, those in flight terminate with their request.
+    // The upload is stopped and its file closed: it is resumed after the next sign in.
+    TLUploadImagePendingRequest *uploadRequest;
+    @synchronized (self) {
+        [self.prefetchQueue removeAllObjects];
+        uploadRequest = self.uploadRequest;
+        self.uploadRequest = nil;
+        if (uploadRequest) {
+            [self.pendingRequests removeObjectForKey:[NSNumber numberWithLongLong:uploadRequest.requestId]];
+            self.checkUpload = YES;
+        }
+    }
+    [uploadRequest close];
+    [[self.twinlife getJobService] finishWithJob:self.imageJob];
 }
 
 - (void)onTwinlifeSuspend {
@@ -502,18 +712,30 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     }
 }
 
+- (TLServerPriority)priorityWithIQ:(nonnull TLBinaryPacketIQ *)iq {
+
+    return [iq isKindOfClass:[TLPutImageIQ class]] ? TLServerPriorityBulk : TLServerPriorityNormal;
+}
+
 #pragma mark - TLImageService
 
 - (nullable UIImage *)getCachedImageIfPresentWithImageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind {
     DDLogVerbose(@"%@ getCachedImageIfPresentWithImageId: %@ kind: %d", LOG_TAG, imageId, kind);
 
-    if (kind == TLImageServiceKindThumbnail) {
-        // Look at the cache first if the image was already loaded.
-        return [self.thumbnailCache objectForKey:imageId];
+    // Look at the cache first if the image was already loaded.
+    UIImage *image = (kind == TLImageServiceKindThumbnail) ? [self.thumbnailCache objectForKey:imageId] : [self.imageCache objectForKey:imageId];
+    if (image) {
+        [self countWithKind:kind level:TLImageCacheLevelMemory];
+    }
+    return image;
+}
 
-    } else {
-        // Look at the cache first if the image was already loaded.
-        return [self.imageCache objectForKey:imageId];
+- (nonnull TLImageCacheStats *)getCacheStatsWithKind:(TLImageServiceKind)kind {
+    DDLogVerbose(@"%@ getCacheStatsWithKind: %d", LOG_TAG, kind);
+
+    @synchronized (self) {
+        int64_t *counters = _cacheCounters[kind];
+        return [[TLImageCacheStats alloc] initWithMemoryHits:counters[TLImageCacheLevelMemory] diskHits:counters[TLImageCacheLevelDisk] misses:counters[TLImageCacheLevelMiss]];
     }
 }
 
@@ -524,6 +746,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         // Look at the cache first if the image was already loaded.
         UIImage *image = [self.thumbnailCache objectForKey:imageId];
         if (image) {
+            [self countWithKind:kind level:TLImageCacheLevelMemory];
             return image;
         }
         
@@ -532,22 +755,26 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         if (info && info.data) {
             image = [UIImage imageWithData:info.data];
             if (image) {
-                [self.thumbnailCache setObject:image forKey:imageId];
+                [self cacheWithImage:image imageId:imageId kind:kind];
+                [self countWithKind:kind level:TLImageCacheLevelDisk];
                 return image;
             }
         }
+        [self countWithKind:kind level:TLImageCacheLevelMiss];
         return nil;
         
     } else {
         // Look at the cache first if the image was already loaded.
         UIImage *image = [self.imageCache objectForKey:imageId];
         if (image) {
+            [self countWithKind:kind level:TLImageCacheLevelMemory];
             return image;
         }
         
         // Look in the database if the image is known.
         TLImageInfo *info = [self.serviceProvider loadImageWithImageId:imageId];
         if (!info || info.status == TLImageStatusTypeMissing) {
+            [self countWithKind:kind level:TLImageCacheLevelMiss];
             return nil;
         }
         
@@ -555,12 +782,17 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         NSString *path = [self getCachedImagePathWithImageId:uuid kind:kind];
         NSFileManager *fileManager = [NSFileManager defaultManager];
         if (![fileManager fileExistsAtPath:path]) {
+            [self countWithKind:kind level:TLImageCacheLevelMiss];
             return nil;
         }
         
         image = [UIImage imageWithContentsOfFile:path];
         if (image) {
-            [self.imageCache setObject:image forKey:imageId];
+            [self cacheWithImage:image imageId:imageId kind:kind];
+            [self touchCachedImageWithInfo:info publicId:uuid kind:kind path:path];
+            [self countWithKind:kind level:TLImageCacheLevelDisk];
+        } else {
+            [self countWithKind:kind level:TLImageCacheLevelMiss];
         }
         return image;
     }
@@ -574,6 +806,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         // Look at the cache first if the image was already loaded.
         UIImage *image = [self.thumbnailCache objectForKey:imageId];
         if (image) {
+            [self countWithKind:kind level:TLImageCacheLevelMemory];
             block(TLBaseServiceErrorCodeSuccess, image);
             return;
         }
@@ -583,45 +816,28 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         if (info && info.data) {
             image = [UIImage imageWithData:info.data];
             if (image) {
-                [self.thumbnailCache setObject:image forKey:imageId];
+                [self cacheWithImage:image imageId:imageId kind:kind];
+                [self countWithKind:kind level:TLImageCacheLevelDisk];
                 block(TLBaseServiceErrorCodeSuccess, image);
                 return;
             }
             block(TLBaseServiceErrorCodeNoStorageSpace, image);
             return;
         }
+        [self countWithKind:kind level:TLImageCacheLevelMiss];
         if (!info) {
             block(TLBaseServiceErrorCodeItemNotFound, nil);
             return;
         }
         
         // Get the thumbnail from the server.
-        int64_t requestId = [TLTwinlife newRequestId];
-        TLGetImageIQ *iq = [[TLGetImageIQ alloc] initWithSerializer:IQ_GET_IMAGE_SERIALIZER requestId:requestId imageId:info.publicId kind:kind];
-        
-        TLGetImagePendingRequest *pendingRequest = [[TLGetImagePendingRequest alloc] initWithImageId:imageId publicId:info.publicId kind:kind withBlock:block];
-        @synchronized (self) {
-            // Look for the pending requests and if we are already asking for this same image
-            // don't make a new request to the server but keep it in the chain.
-            for (NSNumber* key in self.pendingRequests) {
-                TLImagePendingRequest *request = self.pendingRequests[key];
-                if ([request isKindOfClass:[TLGetImagePendingRequest class]]) {
-                    TLGetImagePendingRequest *imageRequest = (TLGetImagePendingRequest *)request;
-                    if (imageRequest.kind == kind && [imageRequest.imageId isEqual:imageId]) {
-                        pendingRequest.nextRequest = imageRequest.nextRequest;
-                        imageRequest.nextRequest = pendingRequest;
-                        return;
-                    }
-                }
-            }
-            self.pendingRequests[[NSNumber numberWithLongLong:requestId]] = pendingRequest;
-        }
-        [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
+        [self sendGetImageWithImageId:imageId publicId:info.publicId kind:kind withBlock:block];
         
     } else {
         // Look at the cache first if the image was already loaded.
         UIImage *image = [self.imageCache objectForKey:imageId];
         if (image) {
+            [self countWithKind:kind level:TLImageCacheLevelMemory];
             block(TLBaseServiceErrorCodeSuccess, image);
             return;
         }
@@ -629,6 +845,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         // Look in the database if the image is known or we known it is missing.
         TLImageInfo *info = [self.serviceProvider loadImageWithImageId:imageId];
         if (!info || info.status == TLImageStatusTypeMissing) {
+            [self countWithKind:kind level:TLImageCacheLevelMiss];
             block(TLBaseServiceErrorCodeItemNotFound, nil);
             return;
         }
@@ -660,50 +877,51 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
             }
             image = [UIImage imageWithContentsOfFile:path];
             if (image) {
-                [self.imageCache setObject:image forKey:imageId];
+                [self cacheWithImage:image imageId:imageId kind:kind];
+                [self countWithKind:kind level:TLImageCacheLevelDisk];
                 block(TLBaseServiceErrorCodeSuccess, image);
                 return;
             }
+            [self countWithKind:kind level:TLImageCacheLevelMiss];
             block(TLBaseServiceErrorCodeItemNotFound, image);
             return;
         }
+        TLImageServiceKind fileKind = kind;
         path = [self getCachedImagePathWithImageId:uuid kind:kind];
         // If the large image does not exist, try to look for the normal image size.
         if (kind == TLImageServiceKindLarge && ![fileManager fileExistsAtPath:path]) {
-            path = [self getCachedImagePathWithImageId:uuid kind:TLImageServiceKindNormal];
+            fileKind = TLImageServiceKindNormal;
+            path = [self getCachedImagePathWithImageId:uuid kind:fileKind];
         }
         if ([fileManager fileExistsAtPath:path]) {
             image = [UIImage imageWithContentsOfFile:path];
             if (image) {
-                [self.imageCache setObject:image forKey:imageId];
+                [self cacheWithImage:image imageId:imageId kind:kind];
+                [self touchCachedImageWithInfo:info publicId:uuid kind:fileKind path:path];
+                [self countWithKind:kind level:TLImageCacheLevelDisk];
                 block(TLBaseServiceErrorCodeSuccess, image);
                 return;
             }
         }
+        [self countWithKind:kind level:TLImageCacheLevelMiss];
         
         // Get the image from the server.
-        int64_t requestId = [TLTwinlife newRequestId];
-        TLGetImageIQ *iq = [[TLGetImageIQ alloc] initWithSerializer:IQ_GET_IMAGE_SERIALIZER requestId:requestId imageId:info.publicId kind:kind];
-        
-        TLGetImagePendingRequest *pendingRequest = [[TLGetImagePendingRequest alloc] initWithImageId:imageId publicId:info.publicId kind:kind withBlock:block];
-        @synchronized (self) {
-            // Look for the pending requests and if we are already asking for this same image
-            // don't make a new request to the server but keep it in the chain.
-            for (NSNumber* key in self.pendingRequests) {
-                TLImagePendingRequest *request = self.pendingRequests[key];
-                if ([request isKindOfClass:[TLGetImagePendingRequest class]]) {
-                    TLGetImagePendingRequest *imageRequest = (TLGetImagePendingRequest *)request;
-                    if (imageRequest.kind == kind && [imageRequest.imageId isEqual:imageId]) {
-                        pendingRequest.nextRequest = imageRequest.nextRequest;
-                        imageRequest.nextRequest = pendingRequest;
-                        return;
-                    }
-                }
+        [self sendGetImageWithImageId:imageId publicId:info.publicId kind:kind withBlock:block];
+    }
+}
+
+- (void)prefetchImagesWithImageIds:(nonnull NSArray<TLImageId *> *)imageIds kind:(TLImageServiceKind)kind {
+    DDLogVerbose(@"%@ prefetchImagesWithImageIds: %@ kind: %d", LOG_TAG, imageIds, kind);
+
+    NSCache<TLImageId *, UIImage *> *cache = (kind == TLImageServiceKindThumbnail ? self.thumbnailCache : self.imageCache);
+    @synchronized (self) {
+        for (TLImageId *imageId in imageIds) {
+            if (![cache objectForKey:imageId]) {
+                [self.prefetchQueue addObject:[[TLImagePrefetch alloc] initWithImageId:imageId kind:kind]];
             }
-            self.pendingRequests[[NSNumber numberWithLongLong:requestId]] = pendingRequest;
         }
-        [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
     }
+    [self prefetchNext];
 }
 
 - (void)createImageWithImage:(nullable UIImage *)image thumbnail:(nonnull UIImage *)thumbnail withBlock:(nonnull void (^)(TLBaseServiceErrorCode errorCode, TLExportedImageId *_Nullable imageId))block {
@@ -925,54 +1143,66 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     
     int64_t remainSize = [self.serviceProvider getUploadRemainSizeWithImageId:uploadInfo.imageId kind:kind];
     
-    // Upload the image on the server.
+    // Upload the image on the server, resuming after the part which was acknowledged by the server.
     int64_t requestId = [TLTwinlife newRequestId];
     NSNumber *lRequestId = [NSNumber numberWithLongLong:requestId];
+    int64_t chunkSize = [self computeChunkSize:length serverChunkSize:serverChunkSize];
+    int64_t offset = (remainSize >= length) ? 0 : length - remainSize;
     
-    TLUploadImagePendingRequest *uploadRequest = [[TLUploadImagePendingRequest alloc] initWithImageId:uploadInfo.imageId kind:kind totalLength:length];
+    TLUploadImagePendingRequest *uploadRequest = [[TLUploadImagePendingRequest alloc] initWithImageId:uploadInfo.imageId kind:kind totalLength:length requestId:requestId fileHandle:fileHandle offset:offset chunkSize:chunkSize];
     @synchronized (self) {
         if (self.uploadRequest) {
+            [fileHandle closeFile];
             return;
         }
         self.pendingRequests[lRequestId] = uploadRequest;
         self.uploadRequest = uploadRequest;
     }
     
-    // Send the image in chunks, we don't wait for server to acknowledge the upload.
-    int64_t chunkSize = [self computeChunkSize:length serverChunkSize:serverChunkSize];
-    int64_t offset = 0;
-    if (remainSize >= length) {
-        offset = 0;
-    } else {
-        offset = length - remainSize;
-    }
-    if (offset > 0) {
-        [fileHandle seekToFileOffset:(int)offset];
-    }
-    while (offset < length) {
-        int64_t size = length - offset;
-        if (size > chunkSize) {
-            size = chunkSize;
-        }
-        
-        NSData *data = [fileHandle readDataOfLength:(int)size];
-        TLPutImageIQ *iq = [[TLPutImageIQ alloc] initWithSerializer:IQ_PUT_IMAGE_SERIALIZER requestId:requestId imageId:uploadInfo.imageId.publicId kind:kind offset:offset totalSize:length imageData:data];
-        BOOL queued;
+    [self sendChunksWithUploadRequest:uploadRequest];
+}
+
+/// Send the next chunks of the image while less than MAX_SEND_IMAGE_IQ are waiting for the server acknowledgement.
+/// The chunks are read from the file only when they can be sent so that the memory used does not depend on the image size.
+- (void)sendChunksWithUploadRequest:(nonnull TLUploadImagePendingRequest *)uploadRequest {
+    DDLogVerbose(@"%@ sendChunksWithUploadRequest: %@", LOG_TAG, uploadRequest);
+
+    while (YES) {
         @synchronized (self) {
-            if (uploadRequest.sendCount >= MAX_SEND_IMAGE_IQ) {
-                [uploadRequest.queue addObject:iq];
-                queued = YES;
-            } else {
-                uploadRequest.sendCount++;
-                queued = NO;
+            if (self.uploadRequest != uploadRequest || uploadRequest.sendCount >= MAX_SEND_IMAGE_IQ) {
+                return;
             }
+            uploadRequest.sendCount++;
         }
-        if (!queued) {
-            [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
+
+        int64_t offset = 0;
+        TLBaseServiceErrorCode errorCode;
+        NSData *data = [uploadRequest readChunkWithOffset:&offset errorCode:&errorCode];
+        if (!data) {
+            BOOL failed = NO;
+            @synchronized (self) {
+                uploadRequest.sendCount--;
+                if (errorCode != TLBaseServiceErrorCodeSuccess && self.uploadRequest == uploadRequest) {
+                    [self.pendingRequests removeObjectForKey:[NSNumber numberWithLongLong:uploadRequest.requestId]];
+                    self.uploadRequest = nil;
+                    failed = YES;
+                }
+            }
+            if (failed) {
+                DDLogError(@"%@ upload of %@ failed: %d", LOG_TAG, uploadRequest.imageId, errorCode);
+
+                // The image file cannot be read and the upload will never complete: drop it like
+                // a missing image file and proceed with the next image to upload.
+                [uploadRequest close];
+                [self.serviceProvider saveRemainUploadSizeWithImageId:uploadRequest.imageId kind:uploadRequest.kind remainSize:0];
+                [self backgroundUpload];
+            }
+            return;
         }
-        offset += size;
+
+        TLPutImageIQ *iq = [[TLPutImageIQ alloc] initWithSerializer:IQ_PUT_IMAGE_SERIALIZER requestId:uploadRequest.requestId imageId:uploadRequest.imageId.publicId kind:uploadRequest.kind offset:offset totalSize:uploadRequest.totalLength imageData:data];
+        [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
     }
-    [fileHandle closeFile];
 }
 
 #pragma mark - TLImageService
@@ -993,6 +1223,9 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         request = (TLGetImagePendingRequest *)self.pendingRequests[lRequestId];
         if (onGetImageIQ.imageSha) {
             [self.pendingRequests removeObjectForKey:lRequestId];
+            if (request) {
+                [self removeGetImageRequest:request];
+            }
         }
     }
     if (!request) {
@@ -1001,13 +1234,60 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
 
     // Don't accept an image that is too big for us.
     if (onGetImageIQ.totalSize > self.maxImageSize) {
-        [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
+        [self abortGetImageWithRequestId:lRequestId request:request errorCode:TLBaseServiceErrorCodeNoStorageSpace];
         return;
     }
     
     // We can receive the image in several chunks, the last one contains the image signature.
+    // Normal and large images received in several chunks are appended to a partial file
+    // which is kept if we are disconnected so that the download can continue later.
     NSData *imageData;
-    if (!request.imageReceived && onGetImageIQ.imageSha) {
+    BOOL savedInPart = request.partPath && (request.offset > 0 || onGetImageIQ.offset > 0 || !onGetImageIQ.imageSha);
+    if (request.offset > 0) {
+        // The server answered to our GetImageIQ version 2.
+        @synchronized (self) {
+            [self.resumeAttempts removeObjectForKey:request.partPath];
+        }
+    }
+    if (savedInPart) {
+        if (![self writePartWithRequest:request iq:onGetImageIQ]) {
+            [self abortGetImageWithRequestId:lRequestId request:request errorCode:TLBaseServiceErrorCodeNoStorageSpace];
+            return;
+        }
+        if (!onGetImageIQ.imageSha) {
+            // Restart timer for next chunk.
+            [self packetTimeout:iq.requestId timeout:DEFAULT_REQUEST_TIMEOUT isBinary:YES];
+            return;
+        }
+
+        [request closePart];
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        NSData *sha256 = [self computeSHA256WithPath:request.partPath];
+        if (!sha256 || ![onGetImageIQ.imageSha isEqualToData:sha256]) {
+            [fileManager removeItemAtPath:request.partPath error:nil];
+            [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
+            return;
+        }
+
+        // Replace the image file: getImageWithImageId() only looks at the final path.
+        NSError *error;
+        NSString *path = [self getCachedImagePathWithImageId:request.publicId kind:request.kind];
+        [fileManager removeItemAtPath:path error:nil];
+        if (![fileManager moveItemAtPath:request.partPath toPath:path error:&error]) {
+            [fileManager removeItemAtPath:request.partPath error:nil];
+            [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
+            return;
+        }
+        imageData = [NSData dataWithContentsOfFile:path];
+        if (!imageData) {
+            [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
+            return;
+        }
+
+        [self.serviceProvider touchCachedImageWithPublicId:request.publicId kind:request.kind size:imageData.length];
+        [self evictDiskCache];
+
+    } else if (!request.imageReceived && onGetImageIQ.imageSha) {
         // Only one chunk.
         imageData = onGetImageIQ.imageData;
         NSData *sha256 = [self computeSHA256:imageData];
@@ -1046,7 +1326,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     // Save the image either in the database or in the cache directory.
     if (request.kind == TLImageServiceKindThumbnail) {
         [self.serviceProvider importImageWithImageId:request.imageId status:TLImageStatusTypeRemote thumbnail:imageData imageSha:onGetImageIQ.imageSha];
-    } else {
+    } else if (!savedInPart) {
         NSError *error;
         NSString *path = [self getCachedImagePathWithImageId:request.publicId kind:request.kind];
         NSURL *url = [NSURL fileURLWithPath:path];
@@ -1058,6 +1338,11 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
             [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
             return;
         }
+
+        // The file can be fetched again from the server: record it in the disk cache index so that
+        // it can be evicted when the disk cache is full.
+        [self.serviceProvider touchCachedImageWithPublicId:request.publicId kind:request.kind size:imageData.length];
+        [self evictDiskCache];
     }
     
     // Create the image with the data.
@@ -1066,11 +1351,7 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         [request dispatchWithErrorCode:TLBaseServiceErrorCodeNoStorageSpace image:nil];
         return;
     }
-    if (request.kind == TLImageServiceKindThumbnail) {
-        [self.thumbnailCache setObject:image forKey:request.imageId];
-    } else {
-        [self.imageCache setObject:image forKey:request.imageId];
-    }
+    [self cacheWithImage:image imageId:request.imageId kind:request.kind];
 
     [request dispatchWithErrorCode:TLBaseServiceErrorCodeSuccess image:image];
 }
@@ -1194,23 +1475,22 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     TLOnPutImageIQ *onPutImageIQ = (TLOnPutImageIQ *)iq;
     NSNumber *lRequestId = [NSNumber numberWithLongLong:iq.requestId];
     TLUploadImagePendingRequest *uploadRequest;
-    TLPutImageIQ *nextIQ = nil;
+    TLUploadImagePendingRequest *finishedRequest = nil;
     @synchronized (self) {
+        // Ignore the response of an upload which was dropped (failed to read the image file).
+        if (!self.uploadRequest || self.uploadRequest.requestId != iq.requestId) {
+            return;
+        }
         if (onPutImageIQ.status != TLPutImageStatusTypeIncomplete) {
             [self.pendingRequests removeObjectForKey:lRequestId];
+            finishedRequest = self.uploadRequest;
             self.uploadRequest = nil;
         } else {
             uploadRequest = self.uploadRequest;
-            if (uploadRequest) {
-                if (uploadRequest.queue.count > 0 && uploadRequest.sendCount <= MAX_SEND_IMAGE_IQ) {
-                    nextIQ = uploadRequest.queue.firstObject;
-                    [uploadRequest.queue removeObjectAtIndex:0];
-                } else {
-                    uploadRequest.sendCount--;
-                }
-            }
+            uploadRequest.sendCount--;
         }
     }
+    [finishedRequest close];
     if (!uploadRequest) {
         return;
     }
@@ -1221,10 +1501,10 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     } else {
         [self.serviceProvider saveRemainUploadSizeWithImageId:uploadRequest.imageId kind:uploadRequest.kind remainSize:uploadRequest.totalLength - onPutImageIQ.offset];
     }
-    if (nextIQ) {
-        [self sendBinaryIQ:nextIQ factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
-    } else if (onPutImageIQ.status != TLPutImageStatusTypeIncomplete) {
+    if (onPutImageIQ.status != TLPutImageStatusTypeIncomplete) {
         [self backgroundUpload];
+    } else {
+        [self sendChunksWithUploadRequest:uploadRequest];
     }
 }
 
@@ -1247,9 +1527,23 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
         if (request == self.uploadRequest) {
             self.uploadRequest = nil;
         }
+        if ([request isKindOfClass:[TLGetImagePendingRequest class]]) {
+            [self removeGetImageRequest:(TLGetImagePendingRequest *)request];
+        }
+    }
+    if ([request isKindOfClass:[TLUploadImagePendingRequest class]]) {
+        [(TLUploadImagePendingRequest *)request close];
+        [[self.twinlife getJobService] finishWithJob:self.imageJob];
     }
     if ([request isKindOfClass:[TLGetImagePendingRequest class]]) {
         TLGetImagePendingRequest *imagePendingRequest = (TLGetImagePendingRequest *)request;
+
+        // Keep the partial file when we are disconnected so that we can continue the download.
+        // Otherwise, the server may not know the offset or the image has changed: start from scratch next time.
+        [imagePendingRequest closePart];
+        if (imagePendingRequest.partPath && errorCode != TLBaseServiceErrorCodeTwinlifeOffline) {
+            [[NSFileManager defaultManager] removeItemAtPath:imagePendingRequest.partPath error:nil];
+        }
         [imagePendingRequest dispatchWithErrorCode:errorCode image:nil];
 
     } else if ([request isKindOfClass:[TLCopyImagePendingRequest class]]) {
@@ -1270,20 +1564,32 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     @synchronized (self) {
         self.uploadJob = nil;
         self.checkUpload = uploadInfo != nil;
-        if (!uploadInfo || self.uploadRequest) {
+        if (self.uploadRequest) {
             return;
         }
     }
     
-    if (uploadInfo.remainNormalImage) {
+    if (uploadInfo && uploadInfo.remainNormalImage) {
         NSString *targetPath = [self getCachedImagePathWithImageId:uploadInfo.imageId.publicId kind:TLImageServiceKindNormal];
         [self uploadImageWithInfo:uploadInfo path:targetPath kind:TLImageServiceKindNormal serverChunkSize:self.uploadChunkSize];
     }
     
-    if (uploadInfo.remainLargeImage) {
+    if (uploadInfo && uploadInfo.remainLargeImage) {
         NSString *targetPath = [self getCachedImagePathWithImageId:uploadInfo.imageId.publicId kind:TLImageServiceKindLarge];
         [self uploadImageWithInfo:uploadInfo path:targetPath kind:TLImageServiceKindLarge serverChunkSize:self.uploadChunkSize];
     }
+
+    // Nothing more to upload: the upload job is terminated.
+    if (![self isUploading]) {
+        [[self.twinlife getJobService] finishWithJob:self.imageJob];
+    }
+}
+
+- (BOOL)isUploading {
+
+    @synchronized (self) {
+        return self.uploadRequest != nil;
+    }
 }
 
 - (NSData *)computeSHA256:(NSData *)data {
@@ -1382,6 +1688,234 @@ TL_CREATE_ASSERT_POINT(READ_IMAGE, 201)
     
     path = [self getCachedImagePathWithImageId:imageId kind:TLImageServiceKindLarge];
     [fileManager removeItemAtPath:path error:&error];
+
+    // Drop the partial downloads as well.
+    path = [[self getCachedImagePathWithImageId:imageId kind:TLImageServiceKindNormal] stringByAppendingString:@".part"];
+    [fileManager removeItemAtPath:path error:&error];
+    path = [[self getCachedImagePathWithImageId:imageId kind:TLImageServiceKindLarge] stringByAppendingString:@".part"];
+    [fileManager removeItemAtPath:path error:&error];
+
+    [self.serviceProvider removeCachedImageWithPublicId:imageId];
+}
+
+- (void)cacheWithImage:(nonnull UIImage *)image imageId:(nonnull TLImageId *)imageId kind:(TLImageServiceKind)kind {
+    DDLogVerbose(@"%@ cacheWithImage: %@ imageId: %@ kind: %d", LOG_TAG, image, imageId, kind);
+
+    CGImageRef cgImage = image.CGImage;
+    NSUInteger cost = cgImage ? CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage) : 0;
+    if (kind == TLImageServiceKindThumbnail) {
+        [self.thumbnailCache setObject:image forKey:imageId cost:cost];
+    } else {
+        [self.imageCache setObject:image forKey:imageId cost:cost];
+    }
+}
+
+- (void)sendGetImageWithImageId:(nonnull TLImageId *)imageId publicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind withBlock:(nonnull TLImageConsumer)block {
+    DDLogVerbose(@"%@ sendGetImageWithImageId: %@ publicId: %@ kind: %d", LOG_TAG, imageId, publicId, kind);
+
+    NSString *key = [NSString stringWithFormat:@"%lld.%d", imageId.localId, kind];
+    TLGetImagePendingRequest *pendingRequest = [[TLGetImagePendingRequest alloc] initWithImageId:imageId publicId:publicId kind:kind withBlock:block];
+    int64_t requestId;
+    @synchronized (self) {
+        // If we are already asking for this same image, don't make a new request
+        // to the server but keep it in the chain.
+        TLGetImagePendingRequest *imageRequest = self.getImageRequests[key];
+        if (imageRequest) {
+            pendingRequest.nextRequest = imageRequest.nextRequest;
+            imageRequest.nextRequest = pendingRequest;
+            return;
+        }
+
+        requestId = [TLTwinlife newRequestId];
+        self.pendingRequests[[NSNumber numberWithLongLong:requestId]] = pendingRequest;
+        self.getImageRequests[key] = pendingRequest;
+    }
+
+    // Normal and large images are received in a partial file: if a previous download was interrupted,
+    // ask the server to continue from the data we already have.
+    TLGetImageIQ *iq;
+    if (kind != TLImageServiceKindThumbnail) {
+        pendingRequest.partPath = [[self getCachedImagePathWithImageId:publicId kind:kind] stringByAppendingString:@".part"];
+        NSDictionary<NSFileAttributeKey, id> *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:pendingRequest.partPath error:nil];
+        pendingRequest.offset = attributes ? (int64_t)[attributes fileSize] : 0;
+        if (pendingRequest.offset > 0) {
+            BOOL resume;
+            @synchronized (self) {
+                int attempts = self.resumeAttempts[pendingRequest.partPath].intValue;
+                resume = attempts < MAX_RESUME_ATTEMPTS;
+                if (resume) {
+                    self.resumeAttempts[pendingRequest.partPath] = [NSNumber numberWithInt:attempts + 1];
+                } else {
+                    [self.resumeAttempts removeObjectForKey:pendingRequest.partPath];
+                }
+            }
+            if (!resume) {
+                DDLogWarn(@"%@ no answer to continue the download of %@, restarting from scratch", LOG_TAG, publicId);
+                [[NSFileManager defaultManager] removeItemAtPath:pendingRequest.partPath error:nil];
+                pendingRequest.offset = 0;
+            }
+        }
+    }
+    if (pendingRequest.offset > 0) {
+        iq = [[TLGetImageIQ alloc] initWithSerializer:IQ_GET_IMAGE_RANGE_SERIALIZER requestId:requestId imageId:publicId kind:kind offset:pendingRequest.offset];
+    } else {
+        iq = [[TLGetImageIQ alloc] initWithSerializer:IQ_GET_IMAGE_SERIALIZER requestId:requestId imageId:publicId kind:kind];
+    }
+    [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
+}
+
+- (void)abortGetImageWithRequestId:(nonnull NSNumber *)lRequestId request:(nonnull TLGetImagePendingRequest *)request errorCode:(TLBaseServiceErrorCode)errorCode {
+    DDLogVerbose(@"%@ abortGetImageWithRequestId: %@ errorCode: %d", LOG_TAG, lRequestId, errorCode);
+
+    // Ignore the next chunks that the server could send for this request.
+    @synchronized (self) {
+        if (self.pendingRequests[lRequestId] == request) {
+            [self.pendingRequests removeObjectForKey:lRequestId];
+        }
+        [self removeGetImageRequest:request];
+    }
+    [request closePart];
+    if (request.partPath) {
+        [[NSFileManager defaultManager] removeItemAtPath:request.partPath error:nil];
+    }
+    [request dispatchWithErrorCode:errorCode image:nil];
+}
+
+- (BOOL)writePartWithRequest:(nonnull TLGetImagePendingRequest *)request iq:(nonnull TLOnGetImageIQ *)iq {
+    DDLogVerbose(@"%@ writePartWithRequest: %@ offset: %lld", LOG_TAG, request, iq.offset);
+
+    if (!request.partFile) {
+        // The server sends the image from the start when it does not honor our offset: truncate the partial file.
+        // Use NSFileProtectionComplete as for the image: it can't be accessed if we run in background!
+        if (iq.offset == 0) {
+            if (![[NSFileManager defaultManager] createFileAtPath:request.partPath contents:nil attributes:@{NSFileProtectionKey:NSFileProtectionComplete}]) {
+                return NO;
+            }
+        }
+        request.partFile = [NSFileHandle fileHandleForWritingAtPath:request.partPath];
+        if (!request.partFile) {
+            return NO;
+        }
+    }
+
+    // Chunks must be contiguous with what we have.  The seekToEndOfFile and writeData raise
+    // an exception on I/O errors (ex: no space left on the device).
+    if (@available(iOS 13.4, *)) {
+        NSError *error = nil;
+        unsigned long long offset;
+        if (![request.partFile seekToEndReturningOffset:&offset error:&error]) {
+            DDLogError(@"%@ seek failed: %@", LOG_TAG, error);
+            return NO;
+        }
+        if ((int64_t)offset != iq.offset) {
+            return NO;
+        }
+        if (![request.partFile writeData:iq.imageData error:&error]) {
+            DDLogError(@"%@ write failed: %@", LOG_TAG, error);
+            return NO;
+        }
+    } else {
+        @try {
+            if ((int64_t)[request.partFile seekToEndOfFile] != iq.offset) {
+                return NO;
+            }
+            [request.partFile writeData:iq.imageData];
+        } @catch (NSException *exception) {
+            DDLogError(@"%@ write exception: %@", LOG_TAG, exception);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+/// Must be called with the lock held.
+- (void)removeGetImageRequest:(nonnull TLGetImagePendingRequest *)request {
+    DDLogVerbose(@"%@ removeGetImageRequest: %@", LOG_TAG, request);
+
+    NSString *key = [NSString stringWithFormat:@"%lld.%d", request.imageId.localId, request.kind];
+    if (self.getImageRequests[key] == request) {
+        [self.getImageRequests removeObjectForKey:key];
+    }
+}
+
+/// Start the next prefetches while less than maxPrefetchRequests are waiting for the server.
+/// Images found locally complete immediately and the loop continues with the next one.
+- (void)prefetchNext {
+    DDLogVerbose(@"%@ prefetchNext", LOG_TAG);
+
+    while (YES) {
+        TLImagePrefetch *prefetch;
+        @synchronized (self) {
+            if (self.prefetchRunning) {
+                return;
+            }
+            if (self.prefetchCount >= self.maxPrefetchRequests || self.prefetchQueue.count == 0) {
+                return;
+            }
+            prefetch = self.prefetchQueue.firstObject;
+            [self.prefetchQueue removeObjectAtIndex:0];
+            self.prefetchCount++;
+            self.prefetchRunning = YES;
+        }
+
+        [self getImageWithImageId:prefetch.imageId kind:prefetch.kind withBlock:^(TLBaseServiceErrorCode errorCode, UIImage *image) {
+            BOOL inLoop;
+            @synchronized (self) {
+                self.prefetchCount--;
+                inLoop = self.prefetchRunning;
+            }
+
+            // A running loop looks at the queue again once its getImage returns.
+            if (!inLoop) {
+                [self prefetchNext];
+            }
+        }];
+
+        @synchronized (self) {
+            self.prefetchRunning = NO;
+        }
+    }
+}
+
+- (void)countWithKind:(TLImageServiceKind)kind level:(TLImageCacheLevel)level {
+
+    @synchronized (self) {
+        _cacheCounters[kind][level]++;
+    }
+}
+
+- (void)touchCachedImageWithInfo:(nonnull TLImageInfo *)info publicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind path:(nonnull NSString *)path {
+    DDLogVerbose(@"%@ touchCachedImageWithInfo: %@ publicId: %@ kind: %d", LOG_TAG, info, publicId, kind);
+
+    // Our own images must not be evicted: they are used for the upload and could be the only copy.
+    if (info.status != TLImageStatusTypeRemote && info.status != TLImageStatusTypeNeedFetch) {
+        return;
+    }
+
+    // Avoid the stat() and the database transaction when the access date was updated recently.
+    if ([self.serviceProvider isCachedImageTouchedWithPublicId:publicId kind:kind]) {
+        return;
+    }
+
+    int64_t size = [[[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] objectForKey:NSFileSize] longLongValue];
+    [self.serviceProvider touchCachedImageWithPublicId:publicId kind:kind size:size];
+}
+
+- (void)evictDiskCache {
+    DDLogVerbose(@"%@ evictDiskCache", LOG_TAG);
+
+    // Evict down to 3/4 of the limit to avoid doing this for every new image.
+    NSArray<TLImageCacheEntry *> *list = [self.serviceProvider evictCachedImagesWithMaxSize:MAX_DISK_CACHE_SIZE targetSize:(MAX_DISK_CACHE_SIZE / 4) * 3];
+    if (list.count == 0) {
+        return;
+    }
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    for (TLImageCacheEntry *entry in list) {
+        NSError *error;
+        [fileManager removeItemAtPath:[self getCachedImagePathWithImageId:entry.publicId kind:entry.kind] error:&error];
+    }
+    DDLogInfo(@"%@ evicted %lu images from the disk cache", LOG_TAG, (unsigned long)list.count);
 }
 
 - (nullable NSData *)getImageDataWithImage:(nonnull UIImage *)image {
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020-2025 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -70,6 +70,19 @@ typedef enum {
 
 @end
 
+//
+// Interface: TLImageCacheEntry
+//
+
+@interface TLImageCacheEntry : NSObject
+
+@property (nonnull, readonly) NSUUID *publicId;
+@property (readonly) TLImageServiceKind kind;
+
+- (nonnull instancetype)initWithImageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind;
+
+@end
+
 //
 // Interface: TLImageServiceProvider
 //
@@ -109,4 +122,17 @@ typedef enum {
 
 - (nullable TLExportedImageId *)imageWithPublicId:(nonnull NSUUID *)publicId;
 
+/// Returns YES if the image file access was recorded in the disk cache index recently and it is not necessary to touch it again.
+- (BOOL)isCachedImageTouchedWithPublicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind;
+
+/// Record in the disk cache index that the image file was used: the least recently used files are evicted first.
+- (void)touchCachedImageWithPublicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind size:(int64_t)size;
+
+/// Remove the image files from the disk cache index.
+- (void)removeCachedImageWithPublicId:(nonnull NSUUID *)publicId;
+
+/// When the disk cache size exceeds `maxSize`, remove from the disk cache index the least recently used image files
+/// until the cache size is below `targetSize` and return the image files to remove.
+- (nonnull NSArray<TLImageCacheEntry *> *)evictCachedImagesWithMaxSize:(int64_t)maxSize targetSize:(int64_t)targetSize;
+
 @end
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2020-2025 twinlife SA.
+ *  Copyright (c) 2020-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -39,6 +39,21 @@ static const int ddLogLevel = DDLogLevelWarning;
     " creationDate INTEGER NOT NULL, flags INTEGER, modificationDate INTEGER," \
     " uploadRemain1 INTEGER, uploadRemain2 INTEGER, shaThumbnail BLOB, imageSHAs BLOB, thumbnail BLOB);"
 
+/**
+ * Image cache table: index of the normal and large image files downloaded in the cache directory.
+ * uuid TEXT NOT NULL: the public image ID used for the file name
+ * kind INTEGER NOT NULL: the image kind (normal or large)
+ * size INTEGER NOT NULL: the image file size
+ * accessDate INTEGER NOT NULL: last access date of the image file
+ */
+#define IMAGE_CACHE_CREATE_TABLE \
+    @"CREATE TABLE IF NOT EXISTS imageCache (uuid TEXT NOT NULL, kind INTEGER NOT NULL," \
+    " size INTEGER NOT NULL, accessDate INTEGER NOT NULL, PRIMARY KEY(uuid, kind));"
+
+// Don't update the access date of a cached image file more than once per hour.
+#define IMAGE_CACHE_TOUCH_DELAY (3600 * 1000)
+#define MAX_IMAGE_CACHE_ACCESS_DATES 1024
+
 /**
  * Table from V7 to V19:
  * CREATE TABLE IF NOT EXISTS twincodeImage (id TEXT PRIMARY KEY NOT NULL,
@@ -54,6 +69,12 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 @property (readonly, nonnull) TLImageService *imageService;
 
+/// Last access date written in the imageCache table for the images used recently (indexed by uuid and kind).
+@property (readonly, nonnull) NSMutableDictionary<NSString *, NSNumber *> *accessDates;
+
+/// Total size of the files recorded in the imageCache table or -1 when it must be computed (protected by the accessDates lock).
+@property int64_t cacheSize;
+
 @end
 
 
@@ -114,6 +135,24 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 @end
 
+//
+// Implementation: TLImageCacheEntry
+//
+
+@implementation TLImageCacheEntry
+
+- (nonnull instancetype)initWithImageId:(nonnull NSUUID *)imageId kind:(TLImageServiceKind)kind {
+
+    self = [super init];
+    if (self) {
+        _publicId = imageId;
+        _kind = kind;
+    }
+    return self;
+}
+
+@end
+
 //
 // Implementation: TLImageServiceProvider
 //
@@ -129,15 +168,28 @@ static const int ddLogLevel = DDLogLevelWarning;
     self = [super initWithService:service database:database sqlCreate:IMAGE_CREATE_TABLE table:TLDatabaseTableImage];
     if (self) {
         _imageService = service;
+        _accessDates = [[NSMutableDictionary alloc] init];
+        _cacheSize = -1;
     }
     return self;
 }
 
+- (void)onCreateWithTransaction:(nonnull TLTransaction *)transaction {
+    DDLogVerbose(@"%@ onCreateWithTransaction: %@", LOG_TAG, transaction);
+
+    [super onCreateWithTransaction:transaction];
+    [transaction createSchemaWithSQL:IMAGE_CACHE_CREATE_TABLE];
+}
+
 - (void)onUpgradeWithTransaction:(nonnull TLTransaction *)transaction oldVersion:(int)oldVersion newVersion:(int)newVersion {
     DDLogVerbose(@"%@ onUpgradeWithTransaction: %@ oldVersion: %d newVersion: %d", LOG_TAG, transaction, oldVersion, newVersion);
     
     /*
      * <pre>
+     * Database Version 27
+     *  Date: 2026/10/18
+     *   Add the imageCache table to evict the least recently used image files
+     *
      * Database Version 22
      *  Date: 2024/07/19
      *   Fix bad mapping between Android and iOS for TLImageStatusTypeOwner and TLImageStatusTypeLocale
@@ -158,6 +210,10 @@ static const int ddLogLevel = DDLogLevelWarning;
         // Change 1 to 0 and 0 to 1!
         [transaction executeUpdate:@"UPDATE image SET flags=(flags+1)%2 WHERE flags=0 OR flags=1"];
     }
+
+    if (oldVersion < 27) {
+        [transaction createSchemaWithSQL:IMAGE_CACHE_CREATE_TABLE];
+    }
 }
 
 - (nullable TLExportedImageId *)createImageWithImageId:(nonnull NSUUID *)imageId locale:(BOOL)locale thumbnail:(nonnull NSData *)thumbnail imageShas:(nonnull NSData *)imageShas remain1Size:(int64_t)remain1Size remain2Size:(int64_t)remain2Size {
@@ -449,6 +505,124 @@ static const int ddLogLevel = DDLogLevelWarning;
     return result;
 }
 
+- (BOOL)isCachedImageTouchedWithPublicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind {
+
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    @synchronized (self.accessDates) {
+        NSNumber *accessDate = self.accessDates[[NSString stringWithFormat:@"%@:%d", publicId.UUIDString, kind]];
+        return accessDate && accessDate.longLongValue >= now - IMAGE_CACHE_TOUCH_DELAY;
+    }
+}
+
+- (void)touchCachedImageWithPublicId:(nonnull NSUUID *)publicId kind:(TLImageServiceKind)kind size:(int64_t)size {
+    DDLogVerbose(@"%@ touchCachedImageWithPublicId: %@ kind: %d size: %lld", LOG_TAG, publicId, kind, size);
+
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    NSNumber *accessDate = [NSNumber numberWithLongLong:now];
+    __block BOOL inserted = NO;
+    [self inTransaction:^(TLTransaction *transaction) {
+        NSObject *uuid = [TLDatabaseService toObjectWithUUID:publicId];
+        NSNumber *lKind = [NSNumber numberWithInt:kind];
+        [transaction executeUpdate:@"INSERT OR IGNORE INTO imageCache (uuid, kind, size, accessDate) VALUES(?, ?, ?, ?)", uuid, lKind, [NSNumber numberWithLongLong:size], accessDate];
+        inserted = [transaction changes] > 0;
+        if (!inserted) {
+            [transaction executeUpdate:@"UPDATE imageCache SET size=?, accessDate=? WHERE uuid=? AND kind=? AND (accessDate < ? OR size != ?)", [NSNumber numberWithLongLong:size], accessDate, uuid, lKind, [NSNumber numberWithLongLong:now - IMAGE_CACHE_TOUCH_DELAY], [NSNumber numberWithLongLong:size]];
+        }
+        [transaction commit];
+    }];
+
+    @synchronized (self.accessDates) {
+        // The size of an existing entry could have changed: compute the total again on the next eviction check.
+        if (inserted && self.cacheSize >= 0) {
+            self.cacheSize += size;
+        } else if (!inserted) {
+            self.cacheSize = -1;
+        }
+        if (self.accessDates.count >= MAX_IMAGE_CACHE_ACCESS_DATES) {
+            [self.accessDates removeAllObjects];
+        }
+        self.accessDates[[NSString stringWithFormat:@"%@:%d", publicId.UUIDString, kind]] = accessDate;
+    }
+}
+
+- (void)removeCachedImageWithPublicId:(nonnull NSUUID *)publicId {
+    DDLogVerbose(@"%@ removeCachedImageWithPublicId: %@", LOG_TAG, publicId);
+
+    @synchronized (self.accessDates) {
+        [self.accessDates removeObjectForKey:[NSString stringWithFormat:@"%@:%d", publicId.UUIDString, TLImageServiceKindNormal]];
+        [self.accessDates removeObjectForKey:[NSString stringWithFormat:@"%@:%d", publicId.UUIDString, TLImageServiceKindLarge]];
+        self.cacheSize = -1;
+    }
+
+    [self inTransaction:^(TLTransaction *transaction) {
+        [transaction executeUpdate:@"DELETE FROM imageCache WHERE uuid=?", [TLDatabaseService toObjectWithUUID:publicId]];
+        [transaction commit];
+    }];
+}
+
+- (nonnull NSArray<TLImageCacheEntry *> *)evictCachedImagesWithMaxSize:(int64_t)maxSize targetSize:(int64_t)targetSize {
+    DDLogVerbose(@"%@ evictCachedImagesWithMaxSize: %lld targetSize: %lld", LOG_TAG, maxSize, targetSize);
+
+    NSMutableArray<TLImageCacheEntry *> *result = [[NSMutableArray alloc] init];
+
+    // Use the known total size, or compute it outside of a write transaction: most of the time the limit is not reached.
+    int64_t cacheSize;
+    @synchronized (self.accessDates) {
+        cacheSize = self.cacheSize;
+    }
+    if (cacheSize < 0) {
+        __block int64_t totalSize = 0;
+        [self inDatabase:^(FMDatabase *database) {
+            totalSize = [database longForQuery:@"SELECT SUM(size) FROM imageCache"];
+        }];
+        cacheSize = totalSize;
+        @synchronized (self.accessDates) {
+            self.cacheSize = cacheSize;
+        }
+    }
+    if (cacheSize <= maxSize) {
+        return result;
+    }
+
+    __block int64_t remainSize = -1;
+    [self inTransaction:^(TLTransaction *transaction) {
+        int64_t totalSize = [transaction longForQuery:@"SELECT SUM(size) FROM imageCache"];
+        if (totalSize <= maxSize) {
+            remainSize = totalSize;
+            return;
+        }
+
+        FMResultSet *resultSet = [transaction executeQuery:@"SELECT uuid, kind, size FROM imageCache ORDER BY accessDate"];
+        if (!resultSet) {
+            [self.service onDatabaseErrorWithError:[transaction lastError] line:__LINE__];
+            return;
+        }
+        while (totalSize > targetSize && [resultSet next]) {
+            NSUUID *publicId = [resultSet uuidForColumnIndex:0];
+            int kind = [resultSet intForColumnIndex:1];
+            totalSize -= [resultSet longLongIntForColumnIndex:2];
+            if (publicId) {
+                [result addObject:[[TLImageCacheEntry alloc] initWithImageId:publicId kind:(TLImageServiceKind)kind]];
+            }
+        }
+        [resultSet close];
+
+        for (TLImageCacheEntry *entry in result) {
+            [transaction executeUpdate:@"DELETE FROM imageCache WHERE uuid=? AND kind=?", [TLDatabaseService toObjectWithUUID:entry.publicId], [NSNumber numberWithInt:entry.kind]];
+        }
+        [transaction commit];
+        remainSize = totalSize;
+    }];
+
+    @synchronized (self.accessDates) {
+        self.cacheSize = remainSize;
+        for (TLImageCacheEntry *entry in result) {
+            [self.accessDates removeObjectForKey:[NSString stringWithFormat:@"%@:%d", entry.publicId.UUIDString, entry.kind]];
+        }
+    }
+    return result;
+}
+
 - (nonnull NSNumber *)fromImageStatusType:(TLImageStatusType)type {
     
     switch (type) {
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2019-2025 twinlife SA.
+ *  Copyright (c) 2019-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -44,6 +44,9 @@ typedef enum {
 @property (readonly, nonnull) id<TLJob> job;
 @property (readonly, nullable) NSDate *deadline;
 @property (readonly) TLJobPriority priority;
+@property (readonly, nonnull) NSDate *creationDate;
+@property NSUInteger heapIndex; // Position in the job heap or NSNotFound.
+@property int64_t sequence;     // Order in which the job was added to the job heap.
 
 - (nonnull instancetype)initWithJobService:(nonnull TLJobService *)jobService job:(nonnull id<TLJob>)job deadline:(nullable NSDate*)deadline priority:(TLJobPriority)priority;
 
@@ -51,6 +54,34 @@ typedef enum {
 
 @end
 
+//
+// TLJobTrace
+//
+
+@interface TLJobTrace ()
+
+@property (readonly) int64_t startTime;
+
+- (nonnull instancetype)initWithJobId:(nonnull TLJobId *)jobId startDate:(nonnull NSDate *)startDate startTime:(int64_t)startTime background:(BOOL)background;
+
+- (void)finishWithTime:(int64_t)endTime;
+
+@end
+
+//
+// TLJobStats
+//
+
+@interface TLJobStats ()
+
+- (nonnull instancetype)initWithName:(nonnull NSString *)name;
+
+- (nonnull instancetype)initWithStats:(nonnull TLJobStats *)stats;
+
+- (void)addWithTrace:(nonnull TLJobTrace *)trace;
+
+@end
+
 //
 // TLJobService
 //
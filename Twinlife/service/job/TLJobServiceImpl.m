@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2019-2025 twinlife SA.
+ *  Copyright (c) 2019-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -20,6 +20,11 @@ static const int ddLogLevel = DDLogLevelWarning;
 #endif
 
 #define JOB_UPDATE_DELAY          10.000 // s
+#define JOB_FIRE_TOLERANCE         0.050 // s Run the jobs due within 50ms with the current one instead of waking up again.
+#define MAX_SCHEDULE_LEEWAY      120.0   // s
+#define MAX_JOB_TRACES           256     // Number of job execution records we keep.
+#define PLANNER_DEFAULT_COST     100     // ms Estimated cost of a job that never executed.
+#define PLANNER_SUSPEND_MARGIN   (PRE_SUSPEND_DELAY + SUSPEND_DELAY + DISCONNECT_DELAY) // s Time kept for the suspend sequence.
 #define BACKGROUND_RELEASE_TIMER   1.0 // s
 #define BACKGROUND_RESTORE_DELAY   4.0 // s
 #define SHUTDOWN_TIMEOUT          24.0 // s Shutdown the connection, database 24s after we enter in background.
@@ -62,6 +67,29 @@ static const int ddLogLevel = DDLogLevelWarning;
 //             rationale: we have enough time for the suspend and can give more delay to finish work
 //             When the expiration handler is called, we seem to have between 2 to 4 second.
 
+//
+// Interface: TLJobHeap
+//
+
+/// Binary min-heap of the jobs ordered on their deadline.  Jobs with the same deadline are executed
+/// in the order they were scheduled.  Each job records its position in the heap so that a cancelled
+/// job is removed in O(log n) without scanning the list.
+@interface TLJobHeap : NSObject
+
+- (NSUInteger)count;
+
+- (void)addObject:(nonnull TLJobId *)jobId;
+
+- (void)removeObject:(nullable TLJobId *)jobId;
+
+/// Get the job with the earliest deadline but do not remove it.
+- (nullable TLJobId *)firstObject;
+
+/// Get and remove the job with the earliest deadline.
+- (nullable TLJobId *)peekObject;
+
+@end
+
 //
 // Interface: TLShutdownJob
 //
@@ -84,7 +112,7 @@ static const int ddLogLevel = DDLogLevelWarning;
 @interface TLJobService ()<TLJob>
 
 @property (readonly, nonnull) TLTwinlife *twinlife;
-@property (readonly, nonnull) TLQueue *jobList;
+@property (readonly, nonnull) TLJobHeap *jobList;
 @property (readonly, nonnull) dispatch_source_t scheduleTimer;
 @property (readonly, nonnull) dispatch_source_t backgroundTimer;
 @property (readonly, nonnull) dispatch_source_t disconnectTimer;
@@ -109,6 +137,18 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property atomic_ullong totalForegroundTime;
 @property int idleCounter;
 
+/// Job execution records (ring of MAX_JOB_TRACES entries) and statistics, protected by the jobTraces lock.
+@property (readonly, nonnull) NSMutableArray<TLJobTrace *> *jobTraces;
+@property NSUInteger jobTraceIndex;
+@property (readonly, nonnull) NSMutableDictionary<NSString *, TLJobStats *> *jobStats;
+/// Traces of the jobs whose asynchronous work is not terminated, protected by the jobTraces lock.
+@property (readonly, nonnull) NSMapTable<id<TLJob>, TLJobTrace *> *runningJobs;
+
+/// Background execution planner: jobs that do not fit in the background window and the time
+/// at which the jobs handed out for the current window are projected to be finished.
+@property (readonly, nonnull) NSMutableArray<TLJobId *> *deferredJobs;
+@property int64_t plannedEndTime;
+
 /// Application jobs
 @property (nonnull) NSMutableArray<TLJobId *> *updateJobList;
 @property (nullable) id<TLApplication> application;
@@ -127,6 +167,22 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 - (void)cancelWithJobId:(nonnull TLJobId *)jobId;
 
+/// Execute the job and record its execution time.
+- (void)runWithJobId:(nonnull TLJobId *)jobId;
+
+/// Record the execution trace of a job which terminated at the given time.
+/// An interrupted trace does not measure the job duration and is not used for the job statistics.
+- (void)addWithTrace:(nonnull TLJobTrace *)trace endTime:(int64_t)endTime interrupted:(BOOL)interrupted;
+
+/// Select the due jobs that can be executed before the background window ends, the others are deferred.
+- (nonnull NSArray<TLJobId *> *)planWithJobs:(nonnull NSArray<TLJobId *> *)jobs;
+
+/// Estimate in ms the execution time of a job from its statistics (must be called with the jobTraces lock).
+- (int64_t)estimateWithStats:(nullable TLJobStats *)stats;
+
+/// Put the deferred jobs back in the job list when a new execution window starts.
+- (void)restoreDeferredJobs;
+
 /// Try to disconnect if we are in background and there is no work for us.
 - (void)tryDisconnectTimerHandler;
 
@@ -153,6 +209,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         _jobService = jobService;
         _deadline = deadline;
         _priority = priority;
+        _heapIndex = NSNotFound;
+        _sequence = 0;
+        _creationDate = [[NSDate alloc] init];
     }
     return self;
 }
@@ -192,6 +251,252 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 @end
 
+//
+// Implementation: TLJobTrace
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLJobTrace"
+
+@implementation TLJobTrace
+
+- (nonnull instancetype)initWithJobId:(nonnull TLJobId *)jobId startDate:(nonnull NSDate *)startDate startTime:(int64_t)startTime background:(BOOL)background {
+
+    self = [super init];
+    if (self) {
+        _name = NSStringFromClass([(NSObject *)jobId.job class]);
+        _priority = jobId.priority;
+        _scheduledDate = jobId.deadline ? jobId.deadline : jobId.creationDate;
+        _startDate = startDate;
+        _delay = (int64_t)([startDate timeIntervalSinceDate:_scheduledDate] * 1000);
+        _startTime = startTime;
+        _duration = 0;
+        _background = background;
+    }
+    return self;
+}
+
+- (void)finishWithTime:(int64_t)endTime {
+
+    _duration = (endTime - _startTime) / 1000L;
+}
+
+- (NSString *)description {
+
+    NSMutableString* string = [NSMutableString stringWithCapacity:256];
+    [string appendFormat:@"TLJobTrace %@", self.name];
+    [string appendFormat:@" priority: %d", self.priority];
+    [string appendFormat:@" start: %@", self.startDate];
+    [string appendFormat:@" delay: %lld ms", self.delay];
+    [string appendFormat:@" duration: %lld us", self.duration];
+    [string appendFormat:@" background: %d", self.background];
+    return string;
+}
+
+@end
+
+//
+// Implementation: TLJobStats
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLJobStats"
+
+@implementation TLJobStats
+
+- (nonnull instancetype)initWithName:(nonnull NSString *)name {
+
+    self = [super init];
+    if (self) {
+        _name = name;
+    }
+    return self;
+}
+
+- (nonnull instancetype)initWithStats:(nonnull TLJobStats *)stats {
+
+    self = [super init];
+    if (self) {
+        _name = stats.name;
+        _runCount = stats.runCount;
+        _backgroundCount = stats.backgroundCount;
+        _totalDuration = stats.totalDuration;
+        _backgroundDuration = stats.backgroundDuration;
+        _maxDuration = stats.maxDuration;
+        _totalDelay = stats.totalDelay;
+        _maxDelay = stats.maxDelay;
+    }
+    return self;
+}
+
+- (void)addWithTrace:(nonnull TLJobTrace *)trace {
+
+    _runCount++;
+    _totalDuration += trace.duration;
+    if (trace.duration > _maxDuration) {
+        _maxDuration = trace.duration;
+    }
+    if (trace.background) {
+        _backgroundCount++;
+        _backgroundDuration += trace.duration;
+    }
+
+    // A job can run before its deadline when it is executed with the previous one.
+    if (trace.delay > 0) {
+        _totalDelay += trace.delay;
+        if (trace.delay > _maxDelay) {
+            _maxDelay = trace.delay;
+        }
+    }
+}
+
+- (NSString *)description {
+
+    NSMutableString* string = [NSMutableString stringWithCapacity:256];
+    [string appendFormat:@"TLJobStats %@", self.name];
+    [string appendFormat:@" count: %ld", self.runCount];
+    [string appendFormat:@" duration: %lld us", self.totalDuration];
+    [string appendFormat:@" max: %lld us", self.maxDuration];
+    [string appendFormat:@" background: %ld/%lld us", self.backgroundCount, self.backgroundDuration];
+    [string appendFormat:@" max delay: %lld ms", self.maxDelay];
+    return string;
+}
+
+@end
+
+//
+// Implementation: TLJobHeap
+//
+
+#undef LOG_TAG
+#define LOG_TAG @"TLJobHeap"
+
+@implementation TLJobHeap {
+    NSMutableArray<TLJobId *> *_heap;
+    int64_t _sequence;
+}
+
+- (nonnull instancetype)init {
+    DDLogVerbose(@"%@ init", LOG_TAG);
+
+    self = [super init];
+    if (self) {
+        _heap = [[NSMutableArray alloc] init];
+        _sequence = 0;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+
+    return _heap.count;
+}
+
+- (void)addObject:(nonnull TLJobId *)jobId {
+    DDLogVerbose(@"%@ addObject: %@", LOG_TAG, jobId);
+
+    if ([self containsObject:jobId]) {
+        return;
+    }
+
+    jobId.sequence = ++_sequence;
+    jobId.heapIndex = _heap.count;
+    [_heap addObject:jobId];
+    [self siftUpWithIndex:jobId.heapIndex];
+}
+
+- (void)removeObject:(nullable TLJobId *)jobId {
+    DDLogVerbose(@"%@ removeObject: %@", LOG_TAG, jobId);
+
+    if (!jobId || ![self containsObject:jobId]) {
+        return;
+    }
+
+    NSUInteger index = jobId.heapIndex;
+    NSUInteger last = _heap.count - 1;
+    jobId.heapIndex = NSNotFound;
+    if (index != last) {
+        TLJobId *moved = _heap[last];
+        _heap[index] = moved;
+        moved.heapIndex = index;
+        [_heap removeLastObject];
+
+        // The moved job can go either up or down depending on its deadline.
+        [self siftUpWithIndex:index];
+        [self siftDownWithIndex:moved.heapIndex];
+    } else {
+        [_heap removeLastObject];
+    }
+}
+
+- (nullable TLJobId *)firstObject {
+
+    return _heap.count == 0 ? nil : _heap[0];
+}
+
+- (nullable TLJobId *)peekObject {
+    DDLogVerbose(@"%@ peekObject", LOG_TAG);
+
+    TLJobId *jobId = [self firstObject];
+    [self removeObject:jobId];
+    return jobId;
+}
+
+- (BOOL)containsObject:(nonnull TLJobId *)jobId {
+
+    NSUInteger index = jobId.heapIndex;
+    return index < _heap.count && _heap[index] == jobId;
+}
+
+- (BOOL)isBeforeWithJobId:(nonnull TLJobId *)jobId1 jobId:(nonnull TLJobId *)jobId2 {
+
+    NSComparisonResult result = [jobId1 compareWithJobId:jobId2];
+    return result == NSOrderedAscending || (result == NSOrderedSame && jobId1.sequence < jobId2.sequence);
+}
+
+- (void)siftUpWithIndex:(NSUInteger)index {
+
+    TLJobId *jobId = _heap[index];
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        TLJobId *parentJobId = _heap[parent];
+        if (![self isBeforeWithJobId:jobId jobId:parentJobId]) {
+            break;
+        }
+        _heap[index] = parentJobId;
+        parentJobId.heapIndex = index;
+        index = parent;
+    }
+    _heap[index] = jobId;
+    jobId.heapIndex = index;
+}
+
+- (void)siftDownWithIndex:(NSUInteger)index {
+
+    NSUInteger count = _heap.count;
+    TLJobId *jobId = _heap[index];
+    while (YES) {
+        NSUInteger child = 2 * index + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && [self isBeforeWithJobId:_heap[child + 1] jobId:_heap[child]]) {
+            child++;
+        }
+        TLJobId *childJobId = _heap[child];
+        if (![self isBeforeWithJobId:childJobId jobId:jobId]) {
+            break;
+        }
+        _heap[index] = childJobId;
+        childJobId.heapIndex = index;
+        index = child;
+    }
+    _heap[index] = jobId;
+    jobId.heapIndex = index;
+}
+
+@end
+
 #undef LOG_TAG
 #define LOG_TAG @"TLNetworkLock"
 
@@ -329,12 +634,13 @@ static const int ddLogLevel = DDLogLevelWarning;
         _state = TLApplicationStateBackground;
         _backgroundTime = [[NSDate date] timeIntervalSince1970] * 1000;
         _updateJobList = [[NSMutableArray alloc] init];
-        _jobList = [[TLQueue alloc] initWithComparator:^NSComparisonResult(id<NSObject> obj1, id<NSObject> obj2) {
-            TLJobId *job1 = (TLJobId *)obj1;
-            TLJobId *job2 = (TLJobId *)obj2;
-            
-            return [job1 compareWithJobId:job2];
-        }];
+        _jobList = [[TLJobHeap alloc] init];
+        _jobTraces = [[NSMutableArray alloc] initWithCapacity:MAX_JOB_TRACES];
+        _jobTraceIndex = 0;
+        _jobStats = [[NSMutableDictionary alloc] init];
+        _runningJobs = [NSMapTable weakToStrongObjectsMapTable];
+        _deferredJobs = [[NSMutableArray alloc] init];
+        _plannedEndTime = 0;
 
         _backgroundTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.twinlife.twinlifeQueue);
         dispatch_source_set_event_handler(_backgroundTimer, ^{
@@ -504,13 +810,52 @@ static const int ddLogLevel = DDLogLevelWarning;
 
     TLJobId *jobId = [[TLJobId alloc] initWithJobService:self job:job deadline:deadline priority:priority];
     @synchronized (self) {
-        [self.jobList addObject:jobId allowDuplicate:YES];
+        [self.jobList addObject:jobId];
         [self scheduleJobs];
     }
     DDLogVerbose(@"%@ scheduleWithJob: %@ jobId: %@", LOG_TAG, job, jobId);
     return jobId;
 }
 
+- (void)finishWithJob:(nonnull id<TLJob>)job {
+    DDLogVerbose(@"%@ finishWithJob: %@", LOG_TAG, job);
+
+    int64_t endTime = [TLTwinlife timestamp];
+    @synchronized (self.jobTraces) {
+        TLJobTrace *trace = [self.runningJobs objectForKey:job];
+        if (trace) {
+            [self.runningJobs removeObjectForKey:job];
+            [self addWithTrace:trace endTime:endTime interrupted:NO];
+        }
+    }
+}
+
+- (nonnull NSArray<TLJobTrace *> *)getJobTraces {
+    DDLogVerbose(@"%@ getJobTraces", LOG_TAG);
+
+    @synchronized (self.jobTraces) {
+        NSUInteger count = self.jobTraces.count;
+        NSMutableArray<TLJobTrace *> *result = [[NSMutableArray alloc] initWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+            [result addObject:self.jobTraces[(self.jobTraceIndex + i) % count]];
+        }
+        return result;
+    }
+}
+
+- (nonnull NSArray<TLJobStats *> *)getJobStats {
+    DDLogVerbose(@"%@ getJobStats", LOG_TAG);
+
+    NSMutableArray<TLJobStats *> *result = [[NSMutableArray alloc] init];
+    @synchronized (self.jobTraces) {
+        // Return a copy because the statistics are updated when a job is executed.
+        for (NSString *name in self.jobStats) {
+            [result addObject:[[TLJobStats alloc] initWithStats:self.jobStats[name]]];
+        }
+    }
+    return result;
+}
+
 - (nonnull TLNetworkLock *)allocateNetworkLock {
     DDLogVerbose(@"%@ allocateNetworkLock", LOG_TAG);
 
@@ -594,6 +939,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         self.shutdownDeadlineTime = now + SHUTDOWN_TIMEOUT * MSEC_PER_SEC;
     }
 
+    // A new background window starts: give the deferred jobs a chance to run.
+    [self restoreDeferredJobs];
+
     // Trigger connection unless we are suspending.
     if (state != TLApplicationStateSuspending) {
         [self.twinlife connect];
@@ -699,6 +1047,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         }
     }
 
+    // There is no execution budget in foreground.
+    [self restoreDeferredJobs];
+
     int64_t t = activeTime - self.backgroundTime;
     atomic_fetch_add(&_totalBackgroundTime, t);
     if (state != TLApplicationStateSuspending) {
@@ -770,7 +1121,7 @@ static const int ddLogLevel = DDLogLevelWarning;
 
     for (TLJobId *jobId in updateList) {
         dispatch_async([self.twinlife twinlifeQueue], ^{
-            [jobId.job runJob];
+            [self runWithJobId:jobId];
         });
     }
 }
@@ -854,6 +1205,16 @@ static const int ddLogLevel = DDLogLevelWarning;
         self.disconnectTimerActive = YES;
     }
 
+    // The asynchronous work of the running jobs is interrupted by the suspension.
+    int64_t now = [TLTwinlife timestamp];
+    @synchronized (self.jobTraces) {
+        for (TLJobTrace *trace in [self.runningJobs objectEnumerator]) {
+            [self addWithTrace:trace endTime:now interrupted:YES];
+        }
+        [self.runningJobs removeAllObjects];
+    }
+    DDLogInfo(@"%@ job stats: %@", LOG_TAG, [self getJobStats]);
+
     // Suspend step #2: let every service prepare for the suspend.
     // Most service will do minimal work but the PeerConnectionService has to terminate any opened P2P connection.
     // We must then keep the connection to Twinlife server open so that the P2P terminate are completed.
@@ -891,6 +1252,11 @@ static const int ddLogLevel = DDLogLevelWarning;
                     delay = 120.0;
                 }
             }
+
+            // Jobs deferred by the planner are ready to run: ask for the next window as soon as possible.
+            if (self.deferredJobs.count > 0) {
+                delay = 120.0;
+            }
         }
 
         state = self.state;
@@ -1119,22 +1485,28 @@ static const int ddLogLevel = DDLogLevelWarning;
         TLJobId *nextJobId = nil;
 
         NSDate *now = [[NSDate alloc] initWithTimeIntervalSinceNow:0.0];
+        NSDate *limit = [now dateByAddingTimeInterval:JOB_FIRE_TOLERANCE];
+        NSMutableArray<TLJobId *> *dueJobs = [[NSMutableArray alloc] init];
         while (1) {
             TLJobId *job = [self.jobList firstObject];
             if (!job) {
                 break;
             }
 
-            if ([job.deadline compare:now] > NSOrderedSame || isSuspending) {
+            if ([job.deadline compare:limit] > NSOrderedSame || isSuspending) {
                 nextJobId = job;
                 break;
             }
 
+            [dueJobs addObject:job];
+            [self.jobList peekObject];
+        }
+
+        for (TLJobId *job in [self planWithJobs:dueJobs]) {
             dispatch_async([self.twinlife twinlifeQueue], ^{
                 DDLogVerbose(@"%@ runJob job: %@ now: %@ delta: %f", LOG_TAG, job, now, [job.deadline timeIntervalSinceDate:now]);
-                [job.job runJob];
+                [self runWithJobId:job];
             });
-            [self.jobList peekObject];
         }
 
         [self setScheduleTimerWithJob:nextJobId];
@@ -1172,6 +1544,203 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 #pragma mark - Private methods
 
+- (void)runWithJobId:(nonnull TLJobId *)jobId {
+    DDLogVerbose(@"%@ runWithJobId: %@", LOG_TAG, jobId);
+
+    id<TLJob> job = jobId.job;
+    BOOL background = self.state != TLApplicationStateForeground;
+    TLJobTrace *trace = [[TLJobTrace alloc] initWithJobId:jobId startDate:[[NSDate alloc] init] startTime:[TLTwinlife timestamp] background:background];
+
+    // The trace of a job doing asynchronous work is recorded when the job reports its end with finishWithJob.
+    // It is registered before runJob because that work can terminate before runJob returns.
+    BOOL async = [(NSObject *)job respondsToSelector:@selector(isJobRunning)];
+    if (async) {
+        @synchronized (self.jobTraces) {
+            // The previous asynchronous work was not reported as terminated: stop its trace now.
+            TLJobTrace *previous = [self.runningJobs objectForKey:job];
+            if (previous) {
+                [self addWithTrace:previous endTime:trace.startTime interrupted:YES];
+            }
+            [self.runningJobs setObject:trace forKey:job];
+        }
+    }
+
+    [job runJob];
+
+    if (async && [job isJobRunning]) {
+        return;
+    }
+
+    int64_t endTime = [TLTwinlife timestamp];
+    @synchronized (self.jobTraces) {
+        if (async) {
+            if ([self.runningJobs objectForKey:job] != trace) {
+                return;
+            }
+            [self.runningJobs removeObjectForKey:job];
+        }
+        [self addWithTrace:trace endTime:endTime interrupted:NO];
+    }
+}
+
+- (void)addWithTrace:(nonnull TLJobTrace *)trace endTime:(int64_t)endTime interrupted:(BOOL)interrupted {
+    DDLogVerbose(@"%@ addWithTrace: %@ endTime: %lld interrupted: %d", LOG_TAG, trace, endTime, interrupted);
+
+    [trace finishWithTime:endTime];
+    @synchronized (self.jobTraces) {
+        if (self.jobTraces.count < MAX_JOB_TRACES) {
+            [self.jobTraces addObject:trace];
+        } else {
+            self.jobTraces[self.jobTraceIndex] = trace;
+            self.jobTraceIndex = (self.jobTraceIndex + 1) % MAX_JOB_TRACES;
+        }
+        if (interrupted) {
+            return;
+        }
+
+        TLJobStats *stats = self.jobStats[trace.name];
+        if (!stats) {
+            stats = [[TLJobStats alloc] initWithName:trace.name];
+            self.jobStats[trace.name] = stats;
+        }
+        [stats addWithTrace:trace];
+    }
+}
+
+- (nonnull NSArray<TLJobId *> *)planWithJobs:(nonnull NSArray<TLJobId *> *)jobs {
+    DDLogVerbose(@"%@ planWithJobs: %@", LOG_TAG, jobs);
+
+    // There is no budget in foreground, during a VoIP call or when iOS did not give us a background window.
+    if (jobs.count == 0 || self.state == TLApplicationStateForeground || self.callCount > 0 || !self.shutdownJob) {
+        return jobs;
+    }
+
+    int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
+    int64_t start = MAX(now, self.plannedEndTime);
+    int64_t budget = self.shutdownDeadlineTime - (int64_t)(PLANNER_SUSPEND_MARGIN * MSEC_PER_SEC) - start;
+
+    // Estimate the cost of each job from its past executions, preferably in background.
+    // The durations include the asynchronous work (upload, conversation operations) reported by the jobs.
+    NSUInteger count = jobs.count;
+    NSMutableData *costData = [[NSMutableData alloc] initWithLength:count * sizeof(int64_t)];
+    NSMutableData *valueData = [[NSMutableData alloc] initWithLength:count * sizeof(double)];
+    int64_t *costs = (int64_t *)costData.mutableBytes;
+    double *values = (double *)valueData.mutableBytes;
+    @synchronized (self.jobTraces) {
+        // The asynchronous work still in progress uses the same background window.
+        // A due job which is running is planned again below: its current work ends when it runs.
+        NSMutableSet<TLJobTrace *> *runningTraces = [[NSMutableSet alloc] initWithArray:[[self.runningJobs objectEnumerator] allObjects]];
+        for (TLJobId *jobId in jobs) {
+            TLJobTrace *trace = [self.runningJobs objectForKey:jobId.job];
+            if (trace) {
+                [runningTraces removeObject:trace];
+            }
+        }
+        int64_t nowTime = [TLTwinlife timestamp];
+        for (TLJobTrace *trace in runningTraces) {
+            int64_t elapsed = (nowTime - trace.startTime) / 1000000L;
+            int64_t expected = [self estimateWithStats:self.jobStats[trace.name]];
+            if (expected > elapsed) {
+                budget -= expected - elapsed;
+            }
+        }
+
+        for (NSUInteger i = 0; i < count; i++) {
+            TLJobId *jobId = jobs[i];
+            costs[i] = MAX([self estimateWithStats:self.jobStats[NSStringFromClass([(NSObject *)jobId.job class])]], 1);
+
+            // Messages are worth more than updates which are worth more than reports.
+            switch (jobId.priority) {
+                case TLJobPriorityMessage:
+                    values[i] = 4.0 / costs[i];
+                    break;
+
+                case TLJobPriorityUpdate:
+                    values[i] = 2.0 / costs[i];
+                    break;
+
+                case TLJobPriorityReport:
+                    values[i] = 1.0 / costs[i];
+                    break;
+            }
+        }
+    }
+
+    // Hand out the jobs by value per millisecond while the projected completion is within the budget.
+    // The messages are never deferred and the shutdown job must always run since it terminates the background window.
+    NSMutableArray<NSNumber *> *order = [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [order addObject:[NSNumber numberWithUnsignedInteger:i]];
+    }
+    [order sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSNumber *index1, NSNumber *index2) {
+        double value1 = values[index1.unsignedIntegerValue];
+        double value2 = values[index2.unsignedIntegerValue];
+        return value1 > value2 ? NSOrderedAscending : (value1 < value2 ? NSOrderedDescending : NSOrderedSame);
+    }];
+
+    NSMutableIndexSet *selected = [[NSMutableIndexSet alloc] init];
+    int64_t planned = 0;
+    for (NSNumber *index in order) {
+        TLJobId *jobId = jobs[index.unsignedIntegerValue];
+        int64_t cost = costs[index.unsignedIntegerValue];
+        if (jobId.priority == TLJobPriorityMessage || planned + cost <= budget) {
+            [selected addIndex:index.unsignedIntegerValue];
+            planned += cost;
+        } else {
+            DDLogInfo(@"%@ defer job %@ cost %lld ms budget %lld ms", LOG_TAG, jobId, cost, budget - planned);
+            [self.deferredJobs addObject:jobId];
+        }
+    }
+    self.plannedEndTime = start + planned;
+
+    // Run the selected jobs in their deadline order, the shutdown job must run after the other due jobs.
+    NSMutableArray<TLJobId *> *result = [[NSMutableArray alloc] initWithCapacity:selected.count];
+    TLJobId *shutdownJobId = nil;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (![selected containsIndex:i]) {
+            continue;
+        }
+        if ([(NSObject *)jobs[i].job isKindOfClass:[TLShutdownJob class]]) {
+            shutdownJobId = jobs[i];
+        } else {
+            [result addObject:jobs[i]];
+        }
+    }
+    if (shutdownJobId) {
+        [result addObject:shutdownJobId];
+    }
+    return result;
+}
+
+- (int64_t)estimateWithStats:(nullable TLJobStats *)stats {
+
+    // A job cannot take more than the background window: cap the estimate to its length.
+    int64_t window = (int64_t)((SHUTDOWN_TIMEOUT - PLANNER_SUSPEND_MARGIN) * MSEC_PER_SEC);
+    if (stats && stats.backgroundCount > 0) {
+        return MIN(stats.backgroundDuration / stats.backgroundCount / 1000L, window);
+    } else if (stats && stats.runCount > 0) {
+        return MIN(stats.totalDuration / stats.runCount / 1000L, window);
+    } else {
+        return PLANNER_DEFAULT_COST;
+    }
+}
+
+- (void)restoreDeferredJobs {
+    DDLogVerbose(@"%@ restoreDeferredJobs", LOG_TAG);
+
+    @synchronized (self) {
+        self.plannedEndTime = 0;
+        if (self.deferredJobs.count == 0) {
+            return;
+        }
+        for (TLJobId *jobId in self.deferredJobs) {
+            [self.jobList addObject:jobId];
+        }
+        [self.deferredJobs removeAllObjects];
+        [self scheduleJobs];
+    }
+}
+
 - (void)cancelWithJobId:(nonnull TLJobId *)jobId {
     DDLogVerbose(@"%@ cancelWithJobId: %@", LOG_TAG, jobId);
 
@@ -1180,6 +1749,7 @@ static const int ddLogLevel = DDLogLevelWarning;
             [self.updateJobList removeObject:jobId];
         } else {
             [self.jobList removeObject:jobId];
+            [self.deferredJobs removeObject:jobId];
         }
         if (self.jobList.count == 0 && self.scheduleTimerActive) {
             dispatch_suspend(self.scheduleTimer);
@@ -1211,7 +1781,7 @@ static const int ddLogLevel = DDLogLevelWarning;
         // Setup the job to execute foreground updates: it is scheduled only when we are connected.
         if (self.online && self.state == TLApplicationStateForeground && !self.updateJobId) {
             self.updateJobId = [[TLJobId alloc] initWithJobService:self job:self deadline:[[NSDate alloc] initWithTimeIntervalSinceNow:JOB_UPDATE_DELAY] priority:TLJobPriorityUpdate];
-            [self.jobList addObject:self.updateJobId allowDuplicate:YES];
+            [self.jobList addObject:self.updateJobId];
         }
 
         TLJobId *nextJobId = [self.jobList firstObject];
@@ -1275,8 +1845,9 @@ static const int ddLogLevel = DDLogLevelWarning;
         } else if (delay <= 120) {
             leeway = 0;
         } else {
-            // For high delay, we can accomodate for a low accuracy.
-            leeway = 120 * NSEC_PER_SEC;
+            // For high delay, we can accomodate for a low accuracy but keep it proportional
+            // to the delay so that a job due in a few minutes is not delayed by two minutes.
+            leeway = (int64_t)(MIN(delay / 10.0, MAX_SCHEDULE_LEEWAY) * NSEC_PER_SEC);
         }
 
         dispatch_time_t tt = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
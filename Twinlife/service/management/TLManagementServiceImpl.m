@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2013-2025 twinlife SA.
+ *  Copyright (c) 2013-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -31,6 +31,8 @@
 #import "TLDeviceInfo.h"
 #import "TLAssertion.h"
 #import "TLProxyDescriptor.h"
+#import "TLBinaryEncoder.h"
+#import "TLBinaryDecoder.h"
 
 #if 0
 static const int ddLogLevel = DDLogLevelVerbose;
@@ -38,7 +40,7 @@ static const int ddLogLevel = DDLogLevelVerbose;
 static const int ddLogLevel = DDLogLevelWarning;
 #endif
 
-#define MANAGEMENT_SERVICE_VERSION @"2.2.1"
+#define MANAGEMENT_SERVICE_VERSION @"2.3.0"
 
 #define MANAGEMENT_SERVICE_PREFERENCES_HAS_CONFIGURATION @"ManagementServiceHasConfiguration"
 #define MANAGEMENT_SERVICE_PREFERENCES_MAX_SENT_FRAME_SIZE @"MaxSentFrameSize"
@@ -55,8 +57,14 @@ static const int ddLogLevel = DDLogLevelWarning;
 #define VALIDATE_CONFIGURATION_CONNECT_STATS    @"connect-stats"
 #define VALIDATE_CONFIGURATION_TIMEZONE         @"timezone"
 
-#define MAX_EVENTS     16
-#define MAX_ASSERTIONS 16
+#define MAX_EVENTS         1024 // Max number of events kept in the ring buffer (the oldest are dropped).
+#define EVENTS_BATCH_SIZE    64 // Number of events that triggers a send when no flush is requested.
+#define MAX_EVENTS_PER_IQ   256 // Max number of events sent in a single TLLogEventIQ.
+#define MAX_ASSERTIONS       16
+
+#define EVENTS_FILE             @"twinlife-events.dat"
+#define EVENTS_FORMAT_RAW       1
+#define EVENTS_FORMAT_LZFSE     2
 
 #define MIN_UPDATE_TTL     120        // 2mn
 #define DEFAULT_TTL      86400        // sec
@@ -107,13 +115,24 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property BOOL setPushNotificationTokenDone;
 @property BOOL mustCleanEnvironment;
 @property BOOL checkPreviousCrash;
-@property (nonnull) NSMutableArray *events;
+@property (nonnull) NSMutableArray<TLEvent *> *events;
+@property (readonly, nullable) NSString *eventsPath;
+@property BOOL eventsSaved; // The events file exists and must be updated when the server acknowledges events.
+@property int droppedEvents;
 @property (nullable) TLJobId *refreshJobId;
 @property int64_t firstAssertionTime;
 @property int assertionCount;
 
 - (void)runRefreshJob;
 
+- (void)addEventsWithList:(nonnull NSArray<TLEvent *> *)events front:(BOOL)front;
+
+- (void)loadEvents;
+
+- (void)saveEvents;
+
+- (void)writeEventsWithList:(nonnull NSArray<TLEvent *> *)events;
+
 @end
 
 static TLBinaryPacketIQSerializer *IQ_VALIDATE_CONFIGURATION_SERIALIZER = nil;
@@ -384,6 +403,7 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
         NSURL *appDir = [[fileManager URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask] objectAtIndex:0];
         NSString *prevCrashPath = [appDir URLByAppendingPathComponent:@"twinlife-crash.stamp"].path;
         int64_t lastCrashStamp = 0;
+        _eventsPath = [appDir URLByAppendingPathComponent:EVENTS_FILE].path;
 
         // Check if a previous crash occurred and protect to report at most 1 crash per day.
         if ([fileManager fileExistsAtPath:prevCrashPath]) {
@@ -478,6 +498,9 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
             self.pushNotificationRemoteToken = TL_MANAGEMENT_SERVICE_PUSH_NOTIFICATION_APNS_WAIT;
         }
     }
+
+    // Restore the events that were not sent before we were suspended or stopped.
+    [self loadEvents];
 }
 
 - (void)onDisconnect {
@@ -498,6 +521,15 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
     [self validateConfigurationWithRequestId:[TLTwinlife newRequestId]];
 }
 
+- (void)onTwinlifeSuspend {
+    DDLogVerbose(@"%@ onTwinlifeSuspend", LOG_TAG);
+
+    [super onTwinlifeSuspend];
+
+    // Keep the events that are not sent or not acknowledged yet, they are sent again when we are online.
+    [self saveEvents];
+}
+
 - (void)onSignOut {
     DDLogVerbose(@"%@ onSignOut", LOG_TAG);
     
@@ -520,6 +552,13 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
     }
     
     [self sendEvents:YES];
+    @synchronized (self) {
+        [self.events removeAllObjects];
+        self.eventsSaved = NO;
+    }
+    if (self.eventsPath) {
+        [[NSFileManager defaultManager] removeItemAtPath:self.eventsPath error:nil];
+    }
     
     // Erase all keys to remove everything (both in the AppGroup and in the user defaults).
     [self eraseConfiguration:[TLTwinlife getAppSharedUserDefaults]];
@@ -546,6 +585,11 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
     [configuration removeObjectForKey:MANAGEMENT_SERVICE_PREFERENCES_ENVIRONMENT_ID];
 }
 
+- (TLServerPriority)priorityWithIQ:(nonnull TLBinaryPacketIQ *)iq {
+
+    return [iq isKindOfClass:[TLLogEventIQ class]] ? TLServerPriorityBulk : TLServerPriorityNormal;
+}
+
 #pragma mark - TLManagementService
 
 - (void)setPushNotificationWithVariant:(NSString *)variant token:(NSString *)token {
@@ -741,18 +785,14 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
 - (void)logEventWithEventId:(NSString *)eventId key:(NSString *)key value:(NSString *)value flush:(BOOL)flush {
     DDLogVerbose(@"%@ logEventWithEventId: %@ value: %@ flush: %@", LOG_TAG, eventId, value, flush ? @"YES" : @"NO");
     
-    @synchronized (self) {
-        [self.events addObject:[[TLEvent alloc] initWithEventId:eventId key:key value:value]];
-    }
+    [self addEventsWithList:@[[[TLEvent alloc] initWithEventId:eventId key:key value:value]] front:NO];
     [self sendEvents:flush];
 }
 
 - (void)logEventWithEventId:(NSString *)eventId attributes:(NSDictionary *)attributes  flush:(BOOL)flush {
     DDLogVerbose(@"%@ logEventWithEventId: %@ attributes: %@ flush: %@", LOG_TAG, eventId, attributes, flush ? @"YES" : @"NO");
     
-    @synchronized (self) {
-        [self.events addObject:[[TLEvent alloc]initWithEventId:eventId attributes:attributes]];
-    }
+    [self addEventsWithList:@[[[TLEvent alloc] initWithEventId:eventId attributes:attributes]] front:NO];
     [self sendEvents:flush];
 }
 
@@ -856,7 +896,7 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
         assertionIQ.applicationId = self.applicationId;
         assertionIQ.applicationVersion = self.applicationVersion;
         NSData *data = [assertionIQ serializeCompactWithSerializerFactory:self.serializerFactory];
-        [self.serverStream sendWithData:data];
+        [self.serverStream sendWithData:data priority:TLServerPriorityBulk];
     }
 }
 
@@ -954,8 +994,15 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
     [self receivedBinaryIQ:iq];
 
     NSNumber *lRequestId = [NSNumber numberWithLongLong:iq.requestId];
+    BOOL eventsSaved;
     @synchronized (self) {
         [self.pendingRequests removeObjectForKey:lRequestId];
+        eventsSaved = self.eventsSaved;
+    }
+
+    // The server has the events: remove them from the events file so that they are not sent again.
+    if (eventsSaved) {
+        [self saveEvents];
     }
 }
 
@@ -1026,7 +1073,7 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
         TLManagementEventsPendingRequest *eventsPendingRequest = (TLManagementEventsPendingRequest *)pendingRequest;
 
         // Prepare to send again the events if we failed due to network error.
-        [self.events addObjectsFromArray:eventsPendingRequest.events];
+        [self addEventsWithList:eventsPendingRequest.events front:YES];
     }
 }
 
@@ -1053,24 +1100,190 @@ TL_CREATE_ASSERT_POINT(ENVIRONMENT, 400)
         return;
     }
 
-    NSArray<TLEvent *> *events;
-    int64_t requestId;
+    // Send the events in large batches: when a flush is requested, send everything in
+    // several IQs of at most MAX_EVENTS_PER_IQ events.
+    while (1) {
+        NSArray<TLEvent *> *events;
+        int64_t requestId;
+        @synchronized (self) {
+            if (!flush && self.events.count < EVENTS_BATCH_SIZE) {
+                return;
+            }
+            if (self.events.count == 0) {
+                return;
+            }
+
+            if (self.events.count <= MAX_EVENTS_PER_IQ) {
+                events = self.events;
+                self.events = [[NSMutableArray alloc] init];
+            } else {
+                NSRange range = NSMakeRange(0, MAX_EVENTS_PER_IQ);
+                events = [self.events subarrayWithRange:range];
+                [self.events removeObjectsInRange:range];
+            }
+            requestId = [TLTwinlife newRequestId];
+            self.pendingRequests[[NSNumber numberWithLongLong:requestId]] = [[TLManagementEventsPendingRequest alloc] initWithEvents:events];
+        }
+
+        TLLogEventIQ *iq = [[TLLogEventIQ alloc] initWithSerializer:IQ_LOG_EVENT_SERIALIZER requestId:requestId events:events];
+        [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
+    }
+}
+
+- (void)addEventsWithList:(nonnull NSArray<TLEvent *> *)events front:(BOOL)front {
+    DDLogVerbose(@"%@ addEventsWithList: %lu front: %d", LOG_TAG, (unsigned long)events.count, front);
+
     @synchronized (self) {
-        if (!flush && self.events.count < MAX_EVENTS) {
-            return;
+        // Events that are re-queued or restored are older than the ones we have.
+        if (front) {
+            [self.events insertObjects:events atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, events.count)]];
+        } else {
+            [self.events addObjectsFromArray:events];
         }
-        if (self.events.count == 0) {
-            return;
+
+        // The buffer is bounded: drop the oldest events (NSMutableArray removes from the head in constant time).
+        if (self.events.count > MAX_EVENTS) {
+            NSUInteger dropCount = self.events.count - MAX_EVENTS;
+            [self.events removeObjectsInRange:NSMakeRange(0, dropCount)];
+            self.droppedEvents += (int)dropCount;
+            DDLogWarn(@"%@ event buffer is full, %d events dropped", LOG_TAG, self.droppedEvents);
         }
+    }
+}
+
+- (void)loadEvents {
+    DDLogVerbose(@"%@ loadEvents", LOG_TAG);
 
-        events = self.events;
-        requestId = [TLTwinlife newRequestId];
-        self.events = [[NSMutableArray alloc] init];
-        self.pendingRequests[[NSNumber numberWithLongLong:requestId]] = [[TLManagementEventsPendingRequest alloc] initWithEvents:events];
+    if (!self.eventsPath) {
+        return;
     }
 
-    TLLogEventIQ *iq = [[TLLogEventIQ alloc] initWithSerializer:IQ_LOG_EVENT_SERIALIZER requestId:requestId events:events];
-    [self sendBinaryIQ:iq factory:self.serializerFactory timeout:DEFAULT_REQUEST_TIMEOUT];
+    // The file is kept until the server acknowledges the events, it is updated by saveEvents.
+    NSData *content = [NSData dataWithContentsOfFile:self.eventsPath];
+    if (!content) {
+        return;
+    }
+
+    NSMutableArray<TLEvent *> *events = [[NSMutableArray alloc] init];
+    @try {
+        TLBinaryDecoder *decoder = [[TLBinaryDecoder alloc] initWithData:content];
+        int format = [decoder readInt];
+        NSData *data = [decoder readData];
+        if (format == EVENTS_FORMAT_LZFSE) {
+            if (@available(iOS 13.0, *)) {
+                data = [data decompressedDataUsingAlgorithm:NSDataCompressionAlgorithmLZFSE error:nil];
+            } else {
+                data = nil;
+            }
+        } else if (format != EVENTS_FORMAT_RAW) {
+            data = nil;
+        }
+        if (data) {
+            decoder = [[TLBinaryDecoder alloc] initWithData:data];
+            int count = [decoder readInt];
+            for (int i = 0; i < count; i++) {
+                NSString *eventId = [decoder readString];
+                int64_t timestamp = [decoder readLong];
+                int attrCount = [decoder readInt];
+                NSMutableDictionary<NSString *, NSString *> *attributes = [[NSMutableDictionary alloc] initWithCapacity:attrCount];
+                for (int j = 0; j < attrCount; j++) {
+                    NSString *name = [decoder readString];
+                    attributes[name] = [decoder readString];
+                }
+                TLEvent *event = [[TLEvent alloc] initWithEventId:eventId attributes:attributes];
+                event.timestamp = (NSInteger)timestamp;
+                [events addObject:event];
+            }
+        }
+    } @catch (NSException *exception) {
+        DDLogError(@"%@ loadEvents: deserialize exception: %@", LOG_TAG, exception);
+    }
+
+    if (events.count > 0) {
+        [self addEventsWithList:events front:YES];
+        @synchronized (self) {
+            self.eventsSaved = YES;
+        }
+    } else {
+        // The file is empty or cannot be read: drop it.
+        [[NSFileManager defaultManager] removeItemAtPath:self.eventsPath error:nil];
+    }
+}
+
+- (void)saveEvents {
+    DDLogVerbose(@"%@ saveEvents", LOG_TAG);
+
+    if (!self.eventsPath) {
+        return;
+    }
+
+    // Serialize the updates of the events file so that an older list never replaces a newer one.
+    @synchronized (self.eventsPath) {
+        NSMutableArray<TLEvent *> *events = [[NSMutableArray alloc] init];
+        @synchronized (self) {
+            // The events sent and not acknowledged by the server are older than the queued events.
+            NSArray<NSNumber *> *requestIds = [[self.pendingRequests allKeys] sortedArrayUsingSelector:@selector(compare:)];
+            for (NSNumber *requestId in requestIds) {
+                TLManagementPendingRequest *pendingRequest = self.pendingRequests[requestId];
+                if ([pendingRequest isKindOfClass:[TLManagementEventsPendingRequest class]]) {
+                    [events addObjectsFromArray:((TLManagementEventsPendingRequest *)pendingRequest).events];
+                }
+            }
+            [events addObjectsFromArray:self.events];
+            self.eventsSaved = events.count > 0;
+        }
+
+        if (events.count == 0) {
+            [[NSFileManager defaultManager] removeItemAtPath:self.eventsPath error:nil];
+        } else {
+            [self writeEventsWithList:events];
+        }
+    }
+}
+
+- (void)writeEventsWithList:(nonnull NSArray<TLEvent *> *)events {
+    DDLogVerbose(@"%@ writeEventsWithList: %lu", LOG_TAG, (unsigned long)events.count);
+
+    // Compact binary encoding with the same layout as the TLLogEventIQ events.
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity:events.count * 64];
+    TLBinaryEncoder *encoder = [[TLBinaryEncoder alloc] initWithData:data];
+    [encoder writeInt:(int)events.count];
+    for (TLEvent *event in events) {
+        [encoder writeString:event.eventId];
+        [encoder writeLong:event.timestamp];
+        if (event.key && event.value) {
+            [encoder writeInt:1];
+            [encoder writeString:event.key];
+            [encoder writeString:event.value];
+        } else if (event.attributes) {
+            [encoder writeInt:(int)event.attributes.count];
+            for (NSString *key in event.attributes) {
+                [encoder writeString:key];
+                [encoder writeString:event.attributes[key]];
+            }
+        } else {
+            [encoder writeInt:0];
+        }
+    }
+
+    // Event names and attributes are very repetitive and compress well.
+    int format = EVENTS_FORMAT_RAW;
+    NSData *payload = data;
+    if (@available(iOS 13.0, *)) {
+        NSData *compressed = [data compressedDataUsingAlgorithm:NSDataCompressionAlgorithmLZFSE error:nil];
+        if (compressed && compressed.length < data.length) {
+            payload = compressed;
+            format = EVENTS_FORMAT_LZFSE;
+        }
+    }
+
+    NSMutableData *content = [[NSMutableData alloc] initWithCapacity:payload.length + 16];
+    encoder = [[TLBinaryEncoder alloc] initWithData:content];
+    [encoder writeInt:format];
+    [encoder writeData:payload];
+    if (![content writeToFile:self.eventsPath atomically:YES]) {
+        DDLogError(@"%@ writeEventsWithList: cannot save %lu events", LOG_TAG, (unsigned long)events.count);
+    }
 }
 
 - (void)setRefreshConfigurationWithTimeout:(long)ttl {
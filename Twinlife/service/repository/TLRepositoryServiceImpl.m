@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2025 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -659,6 +659,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
 @property (nullable) NSMutableArray<TLObjectStatQueue *> *statQueue;
 @property (readonly, nonnull) NSMutableDictionary<NSUUID *, NSArray<TLObjectWeight *> *> *weights;
 @property (readonly, nonnull) NSMutableDictionary<TLDatabaseIdentifier *, TLObjectStatImpl *> *objectStats;
+@property (readonly, nonnull) NSMutableSet<TLDatabaseIdentifier *> *dirtyStats; // Objects with counters changed since the last checkpoint.
 
 @end
 
@@ -700,6 +701,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         _serviceProvider = [[TLRepositoryServiceProvider alloc] initWithService:self database:twinlife.databaseService];
         _weights = [[NSMutableDictionary alloc] init];
         _objectStats = [[NSMutableDictionary alloc] init];
+        _dirtyStats = [[NSMutableSet alloc] init];
 
         // Register the binary IQ handlers for the responses.
         [twinlife addPacketListener:IQ_ON_CREATE_OBJECT_SERIALIZER listener:^(TLBinaryPacketIQ * iq) {
@@ -748,6 +750,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
     // Clear the object stats cache because they could be changed while we are suspended.
     @synchronized (self) {
         [self.objectStats removeAllObjects];
+        [self.dirtyStats removeAllObjects];
     }
 }
 
@@ -1004,7 +1007,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
     @synchronized(self) {
         // Stats are frozen, remember the new item in the queue.
         if (self.statQueue) {
-            [self.statQueue addObject:[[TLObjectStatQueue alloc] initWithObject:object statType:statType value:1]];
+            [self.statQueue addObject:[[TLObjectStatQueue alloc] initWithObject:object statType:statType value:0]];
             return;
         }
         stats = self.objectStats[objectId];
@@ -1026,6 +1029,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         NSArray<TLObjectWeight *> *weights = self.weights[objectId.schemaId];
         @synchronized(self) {
             [stats incrementWithStatType:statType weights:weights];
+            [self.dirtyStats addObject:objectId];
         }
         [self.serviceProvider updateObjectWithStat:stats];
     }
@@ -1043,7 +1047,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
     @synchronized(self) {
         // Stats are frozen, remember the new item in the queue.
         if (self.statQueue) {
-            [self.statQueue addObject:[[TLObjectStatQueue alloc] initWithObject:object statType:statType value:1]];
+            [self.statQueue addObject:[[TLObjectStatQueue alloc] initWithObject:object statType:statType value:value]];
             return;
         }
         stats = self.objectStats[objectId];
@@ -1065,6 +1069,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         NSArray<TLObjectWeight *> *weights = self.weights[objectId.schemaId];
         @synchronized(self) {
             [stats incrementWithStatType:statType weights:weights value:value];
+            [self.dirtyStats addObject:objectId];
         }
         [self.serviceProvider updateObjectWithStat:stats];
     }
@@ -1078,14 +1083,9 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         return;
     }
 
-    // Step 1: freeze the stats and collect the objects of the given schema with their corresponding computed scale factor.
+    // The scores are not re-computed for the whole schema: each object score is maintained when its
+    // stats are incremented, so there is no need to freeze the stats and walk the objects.
     // NSMutableDictionary<NSUUID *, NSNumber *> *objectScales = [[NSMutableDictionary alloc] init];
-    @synchronized(self) {
-        if (!self.statQueue) {
-            self.statQueue = [[NSMutableArray alloc] init];
-        }
-    }
-
     NSMutableArray<id<TLRepositoryObject>> *result = [[NSMutableArray alloc] initWithCapacity:0];
     /*for (TLObjectImpl *object1Impl in objectList) {
 
@@ -1111,9 +1111,6 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         [result addObject:[[TLObject alloc] initWithObjectImpl:object1Impl]];
     }*/
 
-    // Now take into account stats we have queued.
-    [self flushQueueStats];
-
     block(TLBaseServiceErrorCodeSuccess, result);
 }
 
@@ -1151,6 +1148,7 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
                 if (!cachedStat) {
                     [self.objectStats setObject:objectStats forKey:objectId];
                 }
+                [self.dirtyStats addObject:objectId];
             }
             if ((statInfo.peerTwincodeFlags & FLAG_CERTIFIED) != 0) {
                 certifiedCount++;
@@ -1172,20 +1170,23 @@ static NSUUID *OBJECT_STAT_SCHEMA_ID = nil;
         return;
     }
 
-    // Step 1: make a new reference for every object and collect the objects that have new references.
+    // Step 1: make a new reference for the objects whose counters changed since the last checkpoint.
     NSMutableArray<TLObjectStatImpl *> *updateStats = [[NSMutableArray alloc] init];
     @synchronized(self) {
-        for (TLDatabaseIdentifier *objectId in self.objectStats) {
+        for (TLDatabaseIdentifier *objectId in self.dirtyStats) {
             TLObjectStatImpl *objectStat = self.objectStats[objectId];
 
             if (objectStat && [objectStat checkpoint]) {
                 [updateStats addObject:objectStat];
             }
         }
+        [self.dirtyStats removeAllObjects];
     }
 
-    // Step 2: update the objects that have new stat references.
-    [self.serviceProvider updateWithStats:updateStats];
+    // Step 2: update only the objects that have new stat references.
+    if (updateStats.count > 0) {
+        [self.serviceProvider updateWithStats:updateStats];
+    }
 
     // Now take into account stats we have queued.
     [self flushQueueStats];
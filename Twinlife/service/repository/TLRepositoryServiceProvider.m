@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2024 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -493,8 +493,22 @@ static const int ddLogLevel = DDLogLevelWarning;
         [query appendString:@" LEFT JOIN twincodeOutbound AS po on r.peerTwincodeOutbound = po.id"];
     }
     [query filterUUID:schemaId field:@"r.schemaId"];
+
+    // Push the owner, name prefix, date and limit constraints in the SQL query so that we only load and
+    // deserialize the objects that can match: only the acceptWithObject() rules are checked on objects.
+    // With a limit, the most recent objects are returned first.
+    int limit = 0;
     if (filter) {
         [query filterOwner:filter.owner field:@"r.owner"];
+        [query filterPrefix:filter.name field:@"r.name"];
+        [query filterBefore:filter.before field:@"r.modificationDate"];
+        limit = filter.limit;
+        if (limit > 0) {
+            [query order:@"r.modificationDate DESC"];
+            if (!filter.acceptWithObject) {
+                [query limit:limit];
+            }
+        }
     }
     
     __block NSMutableArray<id<TLRepositoryObject>> *result = [[NSMutableArray alloc] init];
@@ -508,6 +522,9 @@ static const int ddLogLevel = DDLogLevelWarning;
             id<TLRepositoryObject> repoObject = [self loadRepositoryObjectWithFactory:factory cursor:resultSet mode:mode offset:0];
             if (repoObject && (!filter || !filter.acceptWithObject || filter.acceptWithObject(repoObject))) {
                 [result addObject:repoObject];
+                if (limit > 0 && result.count >= limit) {
+                    break;
+                }
             }
         }
         [resultSet close];
@@ -631,6 +648,12 @@ static const int ddLogLevel = DDLogLevelWarning;
         NSObject *attributes = [TLDatabaseService toObjectWithData:[TLBinaryCompactEncoder serializeWithAttributes:[object attributesWithAll:NO]]];
         [transaction executeUpdate:@"UPDATE repository SET name=?, description=?, modificationDate=?,"
          "twincodeInbound=?, twincodeOutbound=?, peerTwincodeOutbound=?, owner=?, attributes=? WHERE id=?", name, description, [NSNumber numberWithLongLong:modificationDate], twincodeInbound, twincodeOutbound, peerTwincodeOutbound, owner, attributes, [identifier identifierNumber]];
+
+        // The key pair associated with the twincodes of the object could have changed.
+        [transaction invalidateKeysWithId:[identifier identifierNumber] table:TLDatabaseTableRepository];
+        if (object.twincodeOutbound) {
+            [transaction invalidateKeysWithId:[object.twincodeOutbound.identifier identifierNumber] table:TLDatabaseTableTwincodeOutbound];
+        }
         [transaction commit];
     }];
 }
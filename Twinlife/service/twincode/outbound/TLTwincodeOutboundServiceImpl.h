@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2025 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -83,6 +83,12 @@ typedef void (^TLTwincodeConsumer) (TLBaseServiceErrorCode status, TLTwincodeOut
 
 -(nonnull instancetype)initWithTwincodeId:(nonnull NSUUID *)twincodeId refreshPeriod:(int64_t)refreshPeriod publicKey:(nullable NSString *)publicKey keyIndex:(int)keyIndex secretKey:(nullable NSData *)secretKey trustMethod:(TLTrustMethod)trustMethod complete:(nonnull TLTwincodeConsumer)complete;
 
+/// Add a consumer waiting for the same twincode: it is called when the request completes.
+- (void)addConsumer:(nonnull TLTwincodeConsumer)complete;
+
+/// Complete the request by calling the consumer and all the other waiting consumers.
+- (void)completeWithErrorCode:(TLBaseServiceErrorCode)errorCode twincode:(nullable TLTwincodeOutbound *)twincode;
+
 @end
 
 typedef void (^TLTwincodeRefreshConsumer) (TLBaseServiceErrorCode status, NSMutableArray<TLAttributeNameValue *> * _Nullable updatedAttributes);
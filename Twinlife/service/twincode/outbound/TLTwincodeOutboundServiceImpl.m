@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2014-2025 twinlife SA.
+ *  Copyright (c) 2014-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -104,6 +104,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
 @property (readonly, nonnull) TLTwincodeOutboundJob *twincodeJob;
 @property (readonly, nonnull) TLTwincodeOutboundServiceProvider *serviceProvider;
 @property (readonly, nonnull) NSMutableDictionary<NSNumber *, TLTwincodePendingRequest *> *pendingRequests;
+@property (readonly, nonnull) NSMutableDictionary<NSUUID *, TLGetTwincodePendingRequest *> *getTwincodeRequests;
 @property (readonly, nonnull) TLSerializerFactory *serializerFactory;
 @property (readonly, nonnull) TLCryptoService *cryptoService;
 @property BOOL enableTwincodeRefresh;
@@ -441,6 +442,16 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
 
 #pragma mark - PendingRequests
 
+//
+// Interface: TLGetTwincodePendingRequest ()
+//
+
+@interface TLGetTwincodePendingRequest ()
+
+@property (nullable) NSMutableArray<TLTwincodeConsumer> *consumers;
+
+@end
+
 //
 // Implementation: TLGetTwincodePendingRequest
 //
@@ -463,6 +474,25 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
     return self;
 }
 
+- (void)addConsumer:(nonnull TLTwincodeConsumer)complete {
+    DDLogVerbose(@"%@ addConsumer", LOG_TAG);
+
+    if (!self.consumers) {
+        self.consumers = [[NSMutableArray alloc] init];
+    }
+    [self.consumers addObject:complete];
+}
+
+- (void)completeWithErrorCode:(TLBaseServiceErrorCode)errorCode twincode:(nullable TLTwincodeOutbound *)twincode {
+    DDLogVerbose(@"%@ completeWithErrorCode: %d twincode: %@", LOG_TAG, errorCode, twincode);
+
+    self.complete(errorCode, twincode);
+    for (TLTwincodeConsumer consumer in self.consumers) {
+        consumer(errorCode, twincode);
+    }
+    self.consumers = nil;
+}
+
 @end
 
 //
@@ -641,6 +671,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
     _serviceProvider = [[TLTwincodeOutboundServiceProvider alloc] initWithService:self database:twinlife.databaseService];
     _twincodeJob = [[TLTwincodeOutboundJob alloc] initWithService:self];
     _pendingRequests = [[NSMutableDictionary alloc] init];
+    _getTwincodeRequests = [[NSMutableDictionary alloc] init];
     _serializerFactory = twinlife.serializerFactory;
     _cryptoService = [twinlife getCryptoService];
     _serviceJid = [NSString stringWithFormat:@"%@.%@.twinlife", TWINLIFE_SERVICE_NAME, TWINLIFE_NAME];
@@ -704,6 +735,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
     
     @synchronized(self) {
         [self.pendingRequests removeAllObjects];
+        [self.getTwincodeRequests removeAllObjects];
         if (self.refreshJobId) {
             [self.refreshJobId cancel];
             self.refreshJobId = nil;
@@ -741,7 +773,15 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
     } else {
         NSNumber *requestId = [TLBaseService newRequestId];
         @synchronized(self) {
-            self.pendingRequests[requestId] = [[TLGetTwincodePendingRequest alloc] initWithTwincodeId:twincodeOutboundId refreshPeriod:refreshPeriod publicKey:nil keyIndex:0 secretKey:nil trustMethod:TLTrustMethodNone complete:block];
+            // The same twincode is already being fetched: wait for that request to complete.
+            TLGetTwincodePendingRequest *request = self.getTwincodeRequests[twincodeOutboundId];
+            if (request) {
+                [request addConsumer:block];
+                return;
+            }
+            request = [[TLGetTwincodePendingRequest alloc] initWithTwincodeId:twincodeOutboundId refreshPeriod:refreshPeriod publicKey:nil keyIndex:0 secretKey:nil trustMethod:TLTrustMethodNone complete:block];
+            self.pendingRequests[requestId] = request;
+            self.getTwincodeRequests[twincodeOutboundId] = request;
         }
 
         TLGetTwincodeIQ *iq = [[TLGetTwincodeIQ alloc] initWithSerializer:IQ_GET_TWINCODE_SERIALIZER requestId:requestId.longLongValue twincodeId:twincodeOutboundId];
@@ -1309,6 +1349,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
             return;
         }
         [self.pendingRequests removeObjectForKey:lRequestId];
+        [self removeGetTwincodeRequest:request];
     }
     NSData *signature = onGetTwincodeIQ.signature;
     if ([request isKindOfClass:[TLGetTwincodePendingRequest class]]) {
@@ -1322,9 +1363,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
         if (signature && getRequest.publicKey) {
             TLVerifyResult *result = [self.cryptoService verifyWithPublicKey:getRequest.publicKey twincodeId:getRequest.twincodeId attributes:onGetTwincodeIQ.attributes signature:signature];
             if (result.errorCode != TLBaseServiceErrorCodeSuccess) {
-                if (getRequest.complete) {
-                    getRequest.complete(result.errorCode, nil);
-                }
+                [getRequest completeWithErrorCode:result.errorCode twincode:nil];
                 return;
             }
             pubKey = result.publicSigningKey;
@@ -1332,9 +1371,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
         }
         TLTwincodeOutbound *twincodeOutbound = [self.serviceProvider importTwincodeWithTwincodeId:getRequest.twincodeId attributes:onGetTwincodeIQ.attributes pubSigningKey:pubKey pubEncryptionKey:encryptKey keyIndex:getRequest.keyIndex secretKey:getRequest.secretKey trustMethod:getRequest.trustMethod modificationDate:onGetTwincodeIQ.modificationDate refreshPeriod:getRequest.refreshPeriod];
         
-        if (getRequest.complete) {
-            getRequest.complete(twincodeOutbound ? TLBaseServiceErrorCodeSuccess : TLBaseServiceErrorCodeNoStorageSpace, twincodeOutbound);
-        }
+        [getRequest completeWithErrorCode:twincodeOutbound ? TLBaseServiceErrorCodeSuccess : TLBaseServiceErrorCodeNoStorageSpace twincode:twincodeOutbound];
     } else {
         TLRefreshTwincodePendingRequest *refreshRequest = (TLRefreshTwincodePendingRequest *) request;
         if (!refreshRequest.twincodeOutbound) {
@@ -1569,6 +1606,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
         }
 
         [self.pendingRequests removeObjectForKey:lRequestId];
+        [self removeGetTwincodeRequest:request];
     }
 
     // The object no longer exists on the server, remove it from our local database.
@@ -1577,7 +1615,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
         if (errorCode == TLBaseServiceErrorCodeItemNotFound) {
             [self evictTwincode:getRequest.twincodeId];
         }
-        getRequest.complete(errorCode, nil);
+        [getRequest completeWithErrorCode:errorCode twincode:nil];
 
     } else if ([request isKindOfClass:[TLRefreshTwincodePendingRequest class]]) {
         TLRefreshTwincodePendingRequest *refreshRequest = (TLRefreshTwincodePendingRequest *)request;
@@ -1610,6 +1648,18 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
 
 #pragma mark - Private methods
 
+- (void)removeGetTwincodeRequest:(nonnull TLTwincodePendingRequest *)request {
+    DDLogVerbose(@"%@ removeGetTwincodeRequest: %@", LOG_TAG, request);
+
+    // Must be called with @synchronized(self): once removed, no new consumer can be added to the request.
+    if ([request isKindOfClass:[TLGetTwincodePendingRequest class]]) {
+        TLGetTwincodePendingRequest *getRequest = (TLGetTwincodePendingRequest *)request;
+        if (self.getTwincodeRequests[getRequest.twincodeId] == getRequest) {
+            [self.getTwincodeRequests removeObjectForKey:getRequest.twincodeId];
+        }
+    }
+}
+
 - (void)runRefreshJob {
     DDLogVerbose(@"%@ runRefreshJob", LOG_TAG);
 
@@ -1649,7 +1699,7 @@ static TLBinaryPacketIQSerializer *IQ_ON_GET_INVITATION_CODE_SERIALIZER = nil;
         return;
     }
 
-    int64_t deadline = [self.serviceProvider getRefreshDeadline];
+    int64_t deadline = [self.serviceProvider getRefreshDeadlineWithMaxCount:MAX_REFRESH_TWINCODES];
     if (deadline > 0) {
         NSDate *date = [[NSDate alloc] initWithTimeIntervalSince1970:deadline / 1000LL];
         self.refreshJobId = [[self.twinlife getJobService] scheduleWithJob:self.twincodeJob deadline:date priority:TLJobPriorityMessage];
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2024 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -51,13 +51,15 @@
 /// timestamp and period.  The refresh update is scheduled to be the current date + refresh period.
 - (nullable TLTwincodeOutbound *)refreshTwincodeWithTwincodeId:(long)twincodeId attributes:(nonnull NSArray<TLAttributeNameValue *> *)attributes previousAttributes:(nonnull NSMutableArray<TLAttributeNameValue *> *)previousAttributes modificationDate:(int64_t)modificationDate;
 
-/// Get the next deadline date to refresh the twincodes.
-- (int64_t)getRefreshDeadline;
+/// Get the next deadline date to refresh the twincodes.  The deadline is delayed to refresh a batch of
+/// `maxCount` twincodes when possible.
+- (int64_t)getRefreshDeadlineWithMaxCount:(int)maxCount;
 
-/// Get a list of twincodes that must be refreshed.
+/// Get a list of twincodes that must be refreshed, completed by the twincodes which must be refreshed soon.
 - (nullable TLTwincodeRefreshInfo *)getRefreshListWithMaxCount:(int)maxCount;
 
-/// Update the twincode refresh information and setup a new refresh date based on the currentDate and the twincode refresh period.
+/// Update the twincode refresh information of twincodes which are not changed: their refresh period is increased
+/// and the new refresh date is based on the currentDate and that new refresh period.
 - (void)updateRefreshTimestampWithList:(nonnull NSArray<NSNumber *> *)list refreshTimestamp:(int64_t)refreshTimestamp currentDate:(int64_t)currentDate;
 
 /// Remove the twincode from the database if there is no reference to it from a Conversation and Repository.
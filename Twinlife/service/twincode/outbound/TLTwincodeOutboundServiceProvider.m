@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2015-2025 twinlife SA.
+ *  Copyright (c) 2015-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -29,6 +29,17 @@ static const int ddLogLevel = DDLogLevelWarning;
 
 #define LOG_TAG @"TwincodeOutboundServiceProvider"
 
+// The refresh period of a twincode adapts to its changes: it is doubled each time a refresh reports no change
+// (up to MAX_REFRESH_PERIOD) and divided by 4 when a refresh reports a change (down to TL_REFRESH_PERIOD).
+#define MAX_REFRESH_PERIOD       (24 * TL_REFRESH_PERIOD) // 24 hours (ms)
+#define REFRESH_PERIOD_DECREASE  4
+
+// To send refresh IQs with a full batch of twincodes, the refresh is delayed until enough twincodes are due
+// but no more than REFRESH_BATCH_DELAY after the first one and twincodes due within REFRESH_LOOKAHEAD are
+// refreshed in advance.
+#define REFRESH_BATCH_DELAY      (15 * 60 * 1000)   // 15 minutes (ms)
+#define REFRESH_LOOKAHEAD        (30 * 60 * 1000)   // 30 minutes (ms)
+
 #define TWINCODE_OUTBOUND_SERVICE_PROVIDER_SCHEMA_ID @"20b764ab-7069-4c28-8cab-8c2926d7334a"
 
 /**
@@ -370,31 +381,57 @@ static const int ddLogLevel = DDLogLevelWarning;
             return;
         }
         [self internalUpdateWithTransaction:transaction twincodeOutbound:twincodeOutbound attributes:attributes flags:twincodeOutbound.flags previousAttributes:previousAttributes modificationDate:modificationDate];
+
+        // The twincode was changed: refresh it more often.
+        NSNumber *now = [NSNumber numberWithLongLong:[[NSDate date] timeIntervalSince1970] * 1000];
+        NSNumber *minPeriod = [NSNumber numberWithLongLong:TL_REFRESH_PERIOD];
+        NSNumber *decrease = [NSNumber numberWithInt:REFRESH_PERIOD_DECREASE];
+        [transaction executeUpdate:@"UPDATE twincodeOutbound SET refreshPeriod=MAX(refreshPeriod / ?, ?),"
+         " refreshDate=? + MAX(refreshPeriod / ?, ?) WHERE id=? AND refreshPeriod > ?", decrease, minPeriod, now, decrease, minPeriod, [NSNumber numberWithLong:twincodeId], minPeriod];
         [transaction commit];
         result = twincodeOutbound;
     }];
     return result;
 }
 
-- (int64_t)getRefreshDeadline {
-    DDLogVerbose(@"%@ getRefreshDeadline", LOG_TAG);
+- (int64_t)getRefreshDeadlineWithMaxCount:(int)maxCount {
+    DDLogVerbose(@"%@ getRefreshDeadlineWithMaxCount: %d", LOG_TAG, maxCount);
     
-    __block long deadline = 0;
+    __block int64_t deadline = 0;
     [self inDatabase:^(FMDatabase *database) {
         FMResultSet *resultSet = [database executeQuery:@"SELECT COUNT(*), MIN(refreshDate) FROM twincodeOutbound WHERE refreshPeriod > 0"];
         if (!resultSet) {
             [self.service onDatabaseErrorWithError:[database lastError] line:__LINE__];
             return;
         }
+        long count = 0;
         if ([resultSet next]) {
-            long count = [resultSet longForColumnIndex:0];
-            deadline = [resultSet longForColumnIndex:1];
+            count = [resultSet longForColumnIndex:0];
+            deadline = [resultSet longLongIntForColumnIndex:1];
             // We could have a refreshDate == 0, in that case use a positive value to trigger an immediate refresh.
             if (count > 0 && deadline <= 0) {
                 deadline = 1000L;
             }
         }
         [resultSet close];
+        if (count < maxCount || maxCount <= 1) {
+            return;
+        }
+
+        // Wait for a full batch of twincodes to refresh but not too long after the first one.
+        resultSet = [database executeQuery:@"SELECT refreshDate FROM twincodeOutbound WHERE refreshPeriod > 0"
+                     " ORDER BY refreshDate LIMIT 1 OFFSET ?", [NSNumber numberWithInt:maxCount - 1]];
+        if (!resultSet) {
+            [self.service onDatabaseErrorWithError:[database lastError] line:__LINE__];
+            return;
+        }
+        if ([resultSet next]) {
+            int64_t batchDeadline = [resultSet longLongIntForColumnIndex:0] - REFRESH_LOOKAHEAD;
+            if (batchDeadline > deadline) {
+                deadline = MIN(batchDeadline, deadline + REFRESH_BATCH_DELAY);
+            }
+        }
+        [resultSet close];
     }];
     
     return deadline;
@@ -409,8 +446,10 @@ static const int ddLogLevel = DDLogLevelWarning;
             int64_t timestamp = LONG_MAX;
             int64_t now = [[NSDate date] timeIntervalSince1970] * 1000;
             NSMutableDictionary<NSUUID *, NSNumber *> *list = [[NSMutableDictionary alloc] init];
+            // Take the twincodes which must be refreshed and complete the batch with the next ones.
             FMResultSet *resultSet = [database executeQuery:@"SELECT id, twincodeId, refreshTimestamp"
-                                      " FROM twincodeOutbound WHERE refreshPeriod > 0 AND refreshDate < ? LIMIT ?", [NSNumber numberWithLongLong:now], [NSNumber numberWithInt:maxCount]];
+                                      " FROM twincodeOutbound WHERE refreshPeriod > 0 AND refreshDate < ?"
+                                      " ORDER BY refreshDate LIMIT ?", [NSNumber numberWithLongLong:now + REFRESH_LOOKAHEAD], [NSNumber numberWithInt:maxCount]];
             if (!resultSet) {
                 [self.service onDatabaseErrorWithError:[database lastError] line:__LINE__];
                 return;
@@ -440,8 +479,11 @@ static const int ddLogLevel = DDLogLevelWarning;
     [self inTransaction:^(TLTransaction *transaction) {
         NSNumber *refreshTime = [NSNumber numberWithLongLong:refreshTimestamp];
         NSNumber *now = [NSNumber numberWithLongLong:currentDate];
+        NSNumber *maxPeriod = [NSNumber numberWithLongLong:MAX_REFRESH_PERIOD];
         for (NSNumber *twincodeId in list) {
-            [transaction executeUpdate:@"UPDATE twincodeOutbound SET refreshTimestamp=?, refreshDate=? + refreshPeriod WHERE id=?", refreshTime, now, twincodeId];
+            // The twincode was not changed: refresh it less often.
+            [transaction executeUpdate:@"UPDATE twincodeOutbound SET refreshTimestamp=?, refreshPeriod=MIN(refreshPeriod * 2, MAX(refreshPeriod, ?)),"
+             " refreshDate=? + MIN(refreshPeriod * 2, MAX(refreshPeriod, ?)) WHERE id=?", refreshTime, maxPeriod, now, maxPeriod, twincodeId];
         }
         [transaction commit];
     }];
@@ -528,6 +570,7 @@ static const int ddLogLevel = DDLogLevelWarning;
             [transaction executeUpdate:@"INSERT OR REPLACE INTO secretKeys (id, peerTwincodeId, creationDate, modificationDate, secretUpdateDate, flags, secret1, secret2) values (?, ?, ?, ?, ?, ?, ?, ?)", twincodeId, peerId, [NSNumber numberWithLongLong:creationDate], now, [NSNumber numberWithLongLong:secretUpdateDate], [NSNumber numberWithInt:flags], [TLDatabaseService toObjectWithData:secret1], [TLDatabaseService toObjectWithData:secret2]];
                 
             [transaction executeUpdate:@"DELETE FROM secretKeys WHERE id=? AND peerTwincodeId=?", twincodeId, previousPeerId];
+            [transaction invalidateKeysWithId:twincodeId table:TLDatabaseTableSecretKeys];
         }
 
         // Check if the FLAG_ENCRYPT flags are set on the twincodes:
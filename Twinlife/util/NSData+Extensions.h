@@ -14,4 +14,7 @@
 
 + (nullable NSData *)secureRandomWithLength:(int)length;
 
+/// Compute the SHA256 digest of the file content (returns nil if the file cannot be read).
++ (nullable NSData *)sha256WithPath:(nonnull NSString *)path;
+
 @end
@@ -6,8 +6,12 @@
  *   Stephane Carrez (Stephane.Carrez@twin.life)
  */
 
+#include <CommonCrypto/CommonDigest.h>
+
 #import "NSData+Extensions.h"
 
+#define DIGEST_READ_SIZE (64 * 1024)
+
 //
 // Implementation: NSData (Extensions)
 //
@@ -30,4 +34,34 @@
     return [[NSData alloc] initWithBytesNoCopy:secretData length:length];
 }
 
++ (nullable NSData *)sha256WithPath:(nonnull NSString *)path {
+
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (!fileHandle) {
+        return nil;
+    }
+
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    @try {
+        while (YES) {
+            @autoreleasepool {
+                NSData *data = [fileHandle readDataOfLength:DIGEST_READ_SIZE];
+                if (data.length == 0) {
+                    break;
+                }
+                CC_SHA256_Update(&ctx, [data bytes], (CC_LONG)data.length);
+            }
+        }
+    } @catch (NSException *exception) {
+        [fileHandle closeFile];
+        return nil;
+    }
+    [fileHandle closeFile];
+
+    unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(hash, &ctx);
+    return [NSData dataWithBytes:hash length:CC_SHA256_DIGEST_LENGTH];
+}
+
 @end
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2021-2024 twinlife SA.
+ *  Copyright (c) 2021-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -11,8 +11,18 @@
  * The SHA256 signature is computed while we write the output stream.
  * At the end, the close() method will verify the SHA256 signature.
  * If the signature is not correct, the file is removed and it must be transferred again.
+ *
+ * When the file length is known, chunks can be written at any offset.  The received ranges are tracked
+ * in a bitmap of RECEIVING_BLOCK_SIZE blocks which is saved next to the file (with a ".parts" extension)
+ * so that a transfer that is interrupted resumes on the first missing block instead of the file end.
  */
 
+/// Granularity of the received ranges bitmap: a block is marked only when it is completely written.
+#define RECEIVING_BLOCK_SIZE (16 * 1024)
+
+/// Extension of the file which holds the received ranges bitmap.
+#define RECEIVING_RANGES_EXTENSION @".parts"
+
 @class TLFileInfo;
 
 //
@@ -24,11 +34,19 @@
 /// The file length.
 @property (readonly) int64_t length;
 
+/// The SHA256 of the content computed while it was received: it is set by close when the file
+/// of known length was written completely and in order, it is nil otherwise.
+@property (readonly, nullable) NSData *sha256;
+
 /// Create the receiving stream object.
 - (nonnull instancetype)initWithPath:(nonnull NSString *)path;
 
 - (nonnull instancetype)initWithPath:(nonnull NSString *)path fileInfo:(nonnull TLFileInfo *)fileInfo;
 
+/// Create the receiving stream object for a file of the given length whose chunks can be received in any order.
+/// The received ranges saved by a previous transfer are loaded.
+- (nonnull instancetype)initWithPath:(nonnull NSString *)path length:(int64_t)length;
+
 /// Seek the receiving stream at the given position (raises an exception if there is a problem).
 - (BOOL)seekToFileOffset:(int64_t)position;
 
@@ -37,6 +55,13 @@
 
 - (int64_t)position;
 
+/// Write a block of data at the given offset and record the received range (raises an exception if there is a problem).
+/// Returns the offset of the first missing block, which is the file length when everything was received.
+- (int64_t)writeChunkWithData:(nonnull NSData *)data offset:(int64_t)offset;
+
+/// Get the offset of the first missing block (the file length when the file is complete).
+- (int64_t)nextMissingOffset;
+
 /// Close the receiving stream.
 - (BOOL)close;
 
@@ -47,7 +72,7 @@
 /// If the signature is correct, the modification date is updated.
 - (BOOL)close:(nonnull NSData *)sha256;
 
-/// Cancel receiving the file.
+/// Cancel receiving the file and save the received ranges to resume the transfer later.
 - (void)cancel;
 
 - (BOOL)isOpened;
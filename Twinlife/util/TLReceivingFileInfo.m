@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2021-2024 twinlife SA.
+ *  Copyright (c) 2021-2026 twinlife SA.
  *  SPDX-License-Identifier: AGPL-3.0-only
  *
  *  Contributors:
@@ -15,6 +15,7 @@
 #import "TLTwinlifeImpl.h"
 #import "TLReceivingFileInfo.h"
 #import "TLFileInfo.h"
+#import "NSData+Extensions.h"
 
 #if 0
 static const int ddLogLevel = DDLogLevelVerbose;
@@ -33,9 +34,19 @@ static const int ddLogLevel = DDLogLevelWarning;
 @property (nonnull, readonly) TLFileInfo *fileInfo;
 @property int64_t currentPosition;
 @property CC_SHA256_CTX ctx;
+@property BOOL sequential;
+@property (nullable) NSMutableData *ranges;
+@property (nullable) NSString *rangesPath;
+@property int64_t fileLength;
+@property int64_t firstMissingBlock;
+@property int64_t runStart;
+@property int unsavedBlocks;
 
 @end
 
+/// Save the bitmap after this number of new blocks so that a crash does not lose the whole progress.
+#define RANGES_SAVE_THRESHOLD 64
+
 //
 // Implementation: TLReceivingFileInfo
 //
@@ -53,6 +64,7 @@ static const int ddLogLevel = DDLogLevelWarning;
         _path = path;
         _fileHandle = [NSFileHandle fileHandleForWritingAtPath:path];
         _currentPosition = 0;
+        _sequential = YES;
         CC_SHA256_Init(&_ctx);
     }
     return self;
@@ -67,11 +79,83 @@ static const int ddLogLevel = DDLogLevelWarning;
         _fileInfo = fileInfo;
         _fileHandle = [NSFileHandle fileHandleForWritingAtPath:path];
         _currentPosition = 0;
+        _sequential = YES;
         CC_SHA256_Init(&_ctx);
     }
     return self;
 }
 
+- (nonnull instancetype)initWithPath:(nonnull NSString *)path length:(int64_t)length {
+    DDLogVerbose(@"%@ initWithPath: %@ length: %lld", LOG_TAG, path, length);
+    
+    self = [super init];
+    if (self) {
+        _path = path;
+        _fileHandle = [NSFileHandle fileHandleForWritingAtPath:path];
+        _fileLength = length;
+        _rangesPath = [path stringByAppendingString:RECEIVING_RANGES_EXTENSION];
+        CC_SHA256_Init(&_ctx);
+
+        int64_t blockCount = (length + RECEIVING_BLOCK_SIZE - 1) / RECEIVING_BLOCK_SIZE;
+        NSUInteger size = (NSUInteger)((blockCount + 7) / 8);
+        int64_t fileSize = _fileHandle ? [_fileHandle seekToEndOfFile] : 0;
+        NSData *saved = [NSData dataWithContentsOfFile:_rangesPath];
+        if (saved && saved.length == size) {
+            _ranges = [saved mutableCopy];
+
+        } else {
+            // No bitmap: the file was received sequentially by a previous version and we can
+            // only trust the blocks that are completely written.
+            _ranges = [[NSMutableData alloc] initWithLength:size];
+            [self markWithStart:0 end:MIN(fileSize, length)];
+        }
+
+        // The digest computed on the fly is valid only if we write the whole file in order.
+        _currentPosition = fileSize;
+        _runStart = fileSize;
+        _sequential = fileSize == 0;
+        [self updateFirstMissingBlock];
+        [self saveRanges];
+    }
+    return self;
+}
+
+- (void)markWithStart:(int64_t)start end:(int64_t)end {
+    
+    // Only mark the blocks that are completely covered (the last block can be shorter).
+    int64_t block = (start + RECEIVING_BLOCK_SIZE - 1) / RECEIVING_BLOCK_SIZE;
+    int64_t lastBlock = end == self.fileLength ? (end + RECEIVING_BLOCK_SIZE - 1) / RECEIVING_BLOCK_SIZE : end / RECEIVING_BLOCK_SIZE;
+    uint8_t *bits = self.ranges.mutableBytes;
+    for (; block < lastBlock; block++) {
+        uint8_t mask = (uint8_t)(1 << (block & 7));
+        if ((bits[block >> 3] & mask) == 0) {
+            bits[block >> 3] |= mask;
+            self.unsavedBlocks++;
+        }
+    }
+}
+
+- (void)updateFirstMissingBlock {
+    
+    int64_t blockCount = (self.fileLength + RECEIVING_BLOCK_SIZE - 1) / RECEIVING_BLOCK_SIZE;
+    const uint8_t *bits = self.ranges.bytes;
+    int64_t block = self.firstMissingBlock;
+    while (block < blockCount && (bits[block >> 3] & (1 << (block & 7))) != 0) {
+        block++;
+    }
+    self.firstMissingBlock = block;
+}
+
+- (void)saveRanges {
+    
+    if (self.ranges && self.rangesPath) {
+        // The blocks must be on disk before we claim we have them.
+        [self.fileHandle synchronizeFile];
+        [self.ranges writeToFile:self.rangesPath atomically:YES];
+        self.unsavedBlocks = 0;
+    }
+}
+
 - (BOOL)seekToFileOffset:(int64_t)position {
     DDLogVerbose(@"%@ seekToFileOffset: %lld", LOG_TAG, position);
 
@@ -105,8 +189,59 @@ static const int ddLogLevel = DDLogLevelWarning;
     return self.currentPosition;
 }
 
+- (int64_t)writeChunkWithData:(nonnull NSData *)data offset:(int64_t)offset {
+    DDLogVerbose(@"%@ writeChunkWithData: %@ offset: %lld", LOG_TAG, data, offset);
+
+    if (!self.fileHandle || !self.ranges || offset < 0 || offset + (int64_t)data.length > self.fileLength) {
+        return -1L;
+    }
+
+    // The digest can be computed on the fly only while the chunks are received in order.
+    // A contiguous run of chunks is tracked so that blocks which straddle two chunks are marked.
+    if (offset != self.currentPosition) {
+        self.sequential = NO;
+        self.runStart = offset;
+        [self.fileHandle seekToFileOffset:offset];
+    } else if (self.sequential) {
+        CC_SHA256_Update(&_ctx, [data bytes], (int)data.length);
+    }
+    [self.fileHandle writeData:data];
+    self.currentPosition = offset + data.length;
+
+    [self markWithStart:self.runStart end:self.currentPosition];
+    int64_t aligned = (self.currentPosition / RECEIVING_BLOCK_SIZE) * RECEIVING_BLOCK_SIZE;
+    if (aligned > self.runStart) {
+        self.runStart = aligned;
+    }
+    [self updateFirstMissingBlock];
+    if (self.unsavedBlocks >= RANGES_SAVE_THRESHOLD) {
+        [self saveRanges];
+    }
+    return [self nextMissingOffset];
+}
+
+- (int64_t)nextMissingOffset {
+    
+    if (!self.ranges) {
+        return self.currentPosition;
+    }
+    return MIN(self.firstMissingBlock * RECEIVING_BLOCK_SIZE, self.fileLength);
+}
+
 - (BOOL)close {
     
+    if (self.ranges && [self nextMissingOffset] < self.fileLength) {
+        [self saveRanges];
+    } else {
+        if (self.rangesPath) {
+            [[NSFileManager defaultManager] removeItemAtPath:self.rangesPath error:nil];
+        }
+        if (self.ranges && self.sequential && self.currentPosition == self.fileLength) {
+            unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+            CC_SHA256_Final(hash, &_ctx);
+            _sha256 = [NSData dataWithBytes:hash length:CC_SHA256_DIGEST_LENGTH];
+        }
+    }
     [self.fileHandle closeFile];
     self.fileHandle = nil;
     return YES;
@@ -121,7 +256,15 @@ static const int ddLogLevel = DDLogLevelWarning;
     CC_SHA256_Final(hash, &_ctx);
 
     NSFileManager *fileManager = [NSFileManager defaultManager];
-    NSData *fileSha256 = [NSData dataWithBytes:hash length:CC_SHA256_DIGEST_LENGTH];
+    NSData *fileSha256;
+    if (self.sequential) {
+        fileSha256 = [NSData dataWithBytes:hash length:CC_SHA256_DIGEST_LENGTH];
+    } else {
+        fileSha256 = [NSData sha256WithPath:self.path];
+    }
+    if (self.rangesPath) {
+        [fileManager removeItemAtPath:self.rangesPath error:nil];
+    }
     if (![sha256 isEqualToData:fileSha256]) {
         [fileManager removeItemAtPath:self.path error:nil];
         return NO;
@@ -146,6 +289,7 @@ static const int ddLogLevel = DDLogLevelWarning;
     DDLogVerbose(@"%@ cancel", LOG_TAG);
 
     if (self.fileHandle) {
+        [self saveRanges];
         [self.fileHandle closeFile];
         self.fileHandle = nil;
     }